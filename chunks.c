@@ -0,0 +1,222 @@
+#include "chunks.h"
+#include "download.h"
+#include "json_reader.h"
+#include "trace.h"
+
+typedef struct {
+    char sha256[SHA256_HEX_SIZE];
+    size_t offset;
+    size_t size;
+} chunk;
+
+typedef struct {
+    size_t size;
+    char sha256[SHA256_HEX_SIZE];
+    chunk *chunks;
+    int num_chunks;
+} chunk_index;
+
+typedef struct {
+    size_t bytes_reused;
+    downloading_callback callback;
+    void *params;
+} chunk_progress;
+
+static void free_chunk_index(chunk_index *index) {
+    free(index->chunks);
+    memset(index, 0, sizeof(chunk_index));
+}
+
+// an index has one entry per 64KB or so of cards.pak, it is scanned in place rather than built as a json tree
+static BOOL parse_chunk_index(chunk_index *index, const char *data, size_t size) {
+    memset(index, 0, sizeof(chunk_index));
+
+    json_reader reader;
+    json_reader_init(&reader, data, size);
+    if (json_next(&reader) != JSON_OBJECT_BEGIN) return FALSE;
+
+    int capacity = 0;
+    size_t offset = 0;
+    BOOL has_chunks = FALSE;
+    while (json_next_member(&reader)) {
+        if (json_string_equals(&reader, "size")) {
+            json_read_size(&reader, &index->size);
+        } else if (json_string_equals(&reader, "sha256")) {
+            json_read_string(&reader, index->sha256, SHA256_HEX_SIZE);
+        } else if (json_string_equals(&reader, "chunks")) {
+            if (json_next(&reader) != JSON_ARRAY_BEGIN) break;
+            while (json_next(&reader) == JSON_OBJECT_BEGIN) {
+                if (index->num_chunks == capacity) {
+                    capacity = max(capacity * 2, 1024);
+                    chunk *chunks = (chunk *) realloc(index->chunks, capacity * sizeof(chunk));
+                    if (!chunks) break;
+                    index->chunks = chunks;
+                }
+                chunk *c = &index->chunks[index->num_chunks++];
+                memset(c, 0, sizeof(chunk));
+                c->offset = offset;
+                while (json_next_member(&reader)) {
+                    if (json_string_equals(&reader, "size")) {
+                        json_read_size(&reader, &c->size);
+                    } else if (json_string_equals(&reader, "sha256")) {
+                        json_read_string(&reader, c->sha256, SHA256_HEX_SIZE);
+                    } else {
+                        json_skip_member(&reader);
+                    }
+                }
+                offset += c->size;
+            }
+            has_chunks = reader.type == JSON_ARRAY_END;
+        } else {
+            json_skip_member(&reader);
+        }
+    }
+
+    // the chunks must cover the whole file
+    if (!has_chunks || reader.type != JSON_OBJECT_END || offset != index->size) {
+        free_chunk_index(index);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL read_chunk_index(chunk_index *index, const char *path) {
+    memset(index, 0, sizeof(chunk_index));
+
+    FILE *file_in = fopen(path, "rb");
+    if (!file_in) return FALSE;
+
+    size_t size = get_file_size(path);
+    char *data = (char *) malloc(max(size, (size_t) 1));
+    BOOL result = data && fread(data, 1, size, file_in) == size && parse_chunk_index(index, data, size);
+    free(data);
+    fclose(file_in);
+    return result;
+}
+
+static int compare_chunk_hashes(const void *lhs, const void *rhs) {
+    return strcmp(((const chunk *) lhs)->sha256, ((const chunk *) rhs)->sha256);
+}
+
+// a local chunk is only used if it still has the hash recorded in the index
+static BOOL copy_chunk(FILE *file_in, const chunk *source, char *dest) {
+    if (!seek_file(file_in, source->offset) || fread(dest, 1, source->size, file_in) != source->size) {
+        return FALSE;
+    }
+
+    sha256_context sha;
+    if (!sha256_init(&sha)) return FALSE;
+
+    char digest[SHA256_HEX_SIZE];
+    sha256_update(&sha, dest, source->size);
+    sha256_final_hex(&sha, digest);
+    sha256_free(&sha);
+    return _stricmp(digest, source->sha256) == 0;
+}
+
+static void chunk_progress_callback(int bytes_read, int bytes_total, void *params) {
+    chunk_progress *progress = (chunk_progress *) params;
+    if (progress->callback) {
+        progress->callback(progress->bytes_reused + bytes_read, bytes_total, progress->params);
+    }
+}
+
+int download_file_chunked(const char *filename, const char *url, const memory *index, const char *base_path, const char *base_index_path,
+    char *sha256, size_t *bytes_downloaded, downloading_callback callback, void *params)
+{
+    *bytes_downloaded = 0;
+    double start_time = get_time_seconds();
+
+    int errcode = error_cant_parse_json;
+    chunk_index new_index;
+    chunk_index base_index;
+    memset(&base_index, 0, sizeof(base_index));
+    FILE *base_in = NULL;
+    byte_range *ranges = NULL;
+    int num_ranges = 0;
+    size_t range_bytes = 0;
+
+    mapped_file output;
+    BOOL mapped = FALSE;
+
+    if (!parse_chunk_index(&new_index, index->data, index->size)) {
+        return errcode;
+    }
+    if (new_index.size == 0 || !read_chunk_index(&base_index, base_index_path)) goto finish;
+
+    // local chunks are looked up by hash, wherever they are in the installed file
+    qsort(base_index.chunks, base_index.num_chunks, sizeof(chunk), compare_chunk_hashes);
+
+    errcode = error_cant_write_file;
+    base_in = fopen(base_path, "rb");
+    ranges = (byte_range *) malloc(new_index.num_chunks * sizeof(byte_range));
+    if (!base_in || !ranges) goto finish;
+
+    mapped = TRUE;
+    if (!map_output_file(&output, filename, new_index.size, FALSE)) goto finish;
+    preallocate_output_file(&output);
+
+    for (int i=0; i<new_index.num_chunks; ++i) {
+        const chunk *c = &new_index.chunks[i];
+        const chunk *found = (const chunk *) bsearch(c, base_index.chunks, base_index.num_chunks, sizeof(chunk), compare_chunk_hashes);
+        if (found && found->size == c->size && copy_chunk(base_in, found, output.view + c->offset)) {
+            continue;
+        }
+
+        if (num_ranges != 0 && c->offset - ranges[num_ranges - 1].end <= MAX_CHUNK_RANGE_GAP) {
+            range_bytes += c->offset + c->size - ranges[num_ranges - 1].end;
+            ranges[num_ranges - 1].end = c->offset + c->size;
+        } else {
+            ranges[num_ranges].begin = c->offset;
+            ranges[num_ranges].end = c->offset + c->size;
+            range_bytes += c->size;
+            ++num_ranges;
+        }
+    }
+    fclose(base_in);
+    base_in = NULL;
+    trace_end("chunks", "copy local chunks", start_time, new_index.size - range_bytes);
+
+    chunk_progress progress = { new_index.size - range_bytes, callback, params };
+    chunk_progress_callback(0, new_index.size, &progress);
+
+    // the endpoints are only probed when a chunk is missing
+    errcode = error_ok;
+    if (num_ranges != 0) {
+        endpoint_list endpoints;
+        rank_endpoints(&endpoints, url, new_index.size);
+        errcode = download_ranges(output.view, &endpoints, new_index.size, ranges, num_ranges, chunk_progress_callback, &progress);
+    }
+    if (errcode != error_ok) goto finish;
+    *bytes_downloaded = range_bytes;
+
+    sha256_context sha;
+    if (!sha256_init(&sha)) {
+        errcode = error_cant_write_file;
+        goto finish;
+    }
+    sha256_update(&sha, output.view, new_index.size);
+    sha256_final_hex(&sha, sha256);
+    sha256_free(&sha);
+
+    if (_stricmp(sha256, new_index.sha256) != 0) {
+        errcode = error_checksum_mismatch;
+    }
+
+finish:
+    if (mapped) {
+        unmap_output_file(&output);
+        if (errcode != error_ok) {
+            remove_file(filename);
+        }
+    }
+    if (base_in) {
+        fclose(base_in);
+    }
+    free(ranges);
+    free_chunk_index(&new_index);
+    free_chunk_index(&base_index);
+
+    trace_end("chunks", "download_file_chunked", start_time, *bytes_downloaded);
+    return errcode;
+}
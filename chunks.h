@@ -0,0 +1,22 @@
+#ifndef __CHUNKS_H__
+#define __CHUNKS_H__
+
+#include "sys.h"
+
+// a chunk index describes a file cut at content defined boundaries, so that an edit only changes the chunks around it:
+//   {"size": ..., "sha256": ..., "chunks": [{"size": ..., "sha256": ...}, ...]}
+// chunks follow each other from the start of the file.
+
+#define CHUNK_INDEX_EXTENSION ".chunks"
+
+// ranges of missing chunks closer than this are downloaded with a single request
+#define MAX_CHUNK_RANGE_GAP (64 * 1024)
+
+// rebuilds filename from the chunk index of the new version. chunks that are also found in base_index are copied
+// from base_path, as long as their hash still matches, and the others are downloaded from url with range requests.
+// the digest of the output is stored in sha256, error_checksum_mismatch is returned if it is not the one of the index.
+// bytes_downloaded is set to the number of bytes that were transferred
+int download_file_chunked(const char *filename, const char *url, const memory *index, const char *base_path, const char *base_index_path,
+    char *sha256, size_t *bytes_downloaded, downloading_callback callback, void *params);
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdio.h>
+
+#include "updater.h"
+#include "download.h"
+#include "trace.h"
+
+// runs the same check and install as the launcher without any ui and without starting the client,
+// so that update performance can be measured on any platform.
+// when a threshold is given and not met the exit code is EXIT_REGRESSION, so that the tool can gate a benchmark run
+
+#define EXIT_REGRESSION 100
+
+#define MEGABYTE (1024.0 * 1024.0)
+
+BOOL verbose = FALSE;
+BOOL regression = FALSE;
+
+void print_status(const char *message) {
+    if (verbose) {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+
+double get_rate(size_t bytes, double seconds) {
+    return seconds > 0 ? bytes / seconds / MEGABYTE : 0.0;
+}
+
+// a limit of zero means that no threshold was given
+void check_maximum(const char *name, double value, double limit) {
+    if (limit > 0 && value > limit) {
+        printf("Regression: %s %.3f is above %.3f\n", name, value, limit);
+        regression = TRUE;
+    }
+}
+
+void check_minimum(const char *name, double value, double limit) {
+    if (limit > 0 && value < limit) {
+        printf("Regression: %s %.3f is below %.3f\n", name, value, limit);
+        regression = TRUE;
+    }
+}
+
+void print_verify_stats(int errcode) {
+    const verify_stats *stats = &last_verify_stats;
+    printf("Verify: %ld files, %ld hashed (%llu bytes) in %.3f s\n", stats->num_files, stats->hashed_files,
+        (unsigned long long) stats->hashed_bytes, stats->time);
+    printf("Damaged: %ld, repaired: %ld\n", stats->damaged_files, stats->repaired_files);
+    if (errcode != error_ok) {
+        fprintf(stderr, "Verification failed (error %d)\n", errcode);
+    }
+}
+
+void print_usage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --base-url URL    root of the github api (default " DEFAULT_API_BASE_URL ")\n"
+        "  --dir DIR         install directory (default %s)\n"
+        "  --segments N      parallel connections per file\n"
+        "  --mirror URL      also download release assets from URL, can be repeated\n"
+        "  --check-only      only check for the latest release\n"
+        "  --force           install even if the latest release is already installed\n"
+        "  --verify          check the installed files against the file index, without contacting github\n"
+        "  --repair          download the files that are missing or damaged, or install the latest release\n"
+        "  --verbose         print every status message\n"
+        "  --trace FILE      write a chrome trace of the update to FILE\n"
+        "thresholds, the exit code is %d if one is not met:\n"
+        "  --max-check-time SEC      release check latency\n"
+        "  --max-total-time SEC      time until the client would be launched\n"
+        "  --min-download-rate MBPS  download throughput of the game zip\n"
+        "  --min-unzip-rate MBPS     extraction throughput\n"
+        "  --max-peak-memory MB      peak resident memory\n",
+        program, bang_base_dir ? bang_base_dir : "none", EXIT_REGRESSION);
+}
+
+int main(int argc, char **argv) {
+    updater_ui.status = print_status;
+
+    int errcode = updater_init();
+    if (errcode != error_ok) {
+        fprintf(stderr, "Could not open http session\n");
+        return errcode;
+    }
+
+    BOOL check_only = FALSE;
+    BOOL force = FALSE;
+    BOOL verify = FALSE;
+    BOOL repair = FALSE;
+    double max_check_time = 0;
+    double max_total_time = 0;
+    double min_download_rate = 0;
+    double min_unzip_rate = 0;
+    double max_peak_memory = 0;
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "--base-url") == 0 && i + 1 < argc) {
+            strncpy(api_base_url, argv[++i], STRING_SIZE - 1);
+        } else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            bang_base_dir = argv[++i];
+        } else if (strcmp(argv[i], "--segments") == 0 && i + 1 < argc) {
+            download_segments = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mirror") == 0 && i + 1 < argc) {
+            add_download_mirror(argv[++i]);
+        } else if (strcmp(argv[i], "--check-only") == 0) {
+            check_only = TRUE;
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force = TRUE;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = TRUE;
+        } else if (strcmp(argv[i], "--repair") == 0) {
+            repair = TRUE;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = TRUE;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_enable(argv[++i]);
+        } else if (strcmp(argv[i], "--max-check-time") == 0 && i + 1 < argc) {
+            max_check_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-total-time") == 0 && i + 1 < argc) {
+            max_total_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-download-rate") == 0 && i + 1 < argc) {
+            min_download_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-unzip-rate") == 0 && i + 1 < argc) {
+            min_unzip_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-peak-memory") == 0 && i + 1 < argc) {
+            max_peak_memory = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            updater_cleanup();
+            return 1;
+        }
+    }
+
+    if (!bang_base_dir) {
+        fprintf(stderr, "No install directory\n");
+        updater_cleanup();
+        return 1;
+    }
+
+    if (verify && !repair) {
+        errcode = verify_installation(FALSE);
+        print_verify_stats(errcode);
+        updater_cleanup();
+        return errcode;
+    }
+
+    double start_time = get_time_seconds();
+    int result = FALSE;
+    errcode = must_download_latest_version(&result);
+    double check_time = get_time_seconds() - start_time;
+
+    if (errcode != error_ok) {
+        fprintf(stderr, "Could not determine latest version (error %d)\n", errcode);
+        updater_cleanup();
+        return errcode;
+    }
+    printf("Latest release: %s (%s)\n", bang_zip_information.version, bang_zip_information.commit);
+    printf("Release check: %.3f s\n", check_time);
+    check_maximum("release check time", check_time, max_check_time);
+
+    double total_time = check_time;
+    if (repair && !check_only) {
+        start_time = get_time_seconds();
+        errcode = verify_installation(TRUE);
+        total_time += get_time_seconds() - start_time;
+        print_verify_stats(errcode);
+    } else if (!check_only && (result || force)) {
+        start_time = get_time_seconds();
+        errcode = install_latest_version();
+        total_time += get_time_seconds() - start_time;
+
+        if (errcode != error_ok) {
+            fprintf(stderr, "Installation failed (error %d)\n", errcode);
+        } else {
+            const install_stats *stats = &last_install_stats;
+            double download_rate = get_rate(stats->zip_download_bytes, stats->zip_download_time);
+            double unzip_rate = get_rate(stats->unzip_bytes, stats->unzip_time);
+
+            printf("Download %s: %llu bytes in %.3f s, %.2f MB/s\n", stats->from_delta ? "delta" : "update.zip",
+                (unsigned long long) stats->zip_download_bytes, stats->zip_download_time, download_rate);
+            if (stats->cards_download_bytes != 0) {
+                printf("Download cards.pak: %llu bytes in %.3f s, %.2f MB/s\n",
+                    (unsigned long long) stats->cards_download_bytes, stats->cards_download_time,
+                    get_rate(stats->cards_download_bytes, stats->cards_download_time));
+            }
+            printf("%s: %llu bytes (%llu unchanged) in %.3f s, %.2f MB/s\n",
+                stats->from_delta ? "Patch" : "Extract",
+                (unsigned long long) stats->unzip_bytes, (unsigned long long) stats->unzip_skipped_bytes,
+                stats->unzip_time, unzip_rate);
+            printf("Write: %llu bytes, %.2f MB/s\n", (unsigned long long) stats->write_bytes, get_rate(stats->write_bytes, stats->unzip_time));
+
+            check_minimum("download rate", download_rate, min_download_rate);
+            check_minimum("unzip rate", unzip_rate, min_unzip_rate);
+        }
+    } else if (!check_only) {
+        printf("Already up to date\n");
+    }
+
+    double peak_memory = get_peak_memory_usage() / MEGABYTE;
+    printf("Time to launch: %.3f s\n", total_time);
+    printf("Peak memory: %.1f MB\n", peak_memory);
+    check_maximum("time to launch", total_time, max_total_time);
+    check_maximum("peak memory", peak_memory, max_peak_memory);
+
+    updater_cleanup();
+    if (errcode == error_ok && regression) {
+        return EXIT_REGRESSION;
+    }
+    return errcode;
+}
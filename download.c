@@ -0,0 +1,952 @@
+#include <stdatomic.h>
+
+#include "download.h"
+#include "trace.h"
+
+http_session_config http_config = { "Mozilla/5.0", "", 30000 };
+http_session shared_session;
+
+int download_segments = DOWNLOAD_SEGMENTS;
+
+double download_rate_limit = 0;
+
+// bytes received since the limit was set, by all connections
+static double rate_limit_start;
+static atomic_ullong rate_limit_bytes;
+
+static atomic_int downloads_cancelled;
+
+void cancel_downloads() {
+    atomic_store(&downloads_cancelled, TRUE);
+}
+
+void set_download_rate_limit(double bytes_per_second) {
+    rate_limit_start = get_time_seconds();
+    atomic_store(&rate_limit_bytes, 0);
+    download_rate_limit = bytes_per_second;
+}
+
+char download_mirrors[MAX_MIRRORS][STRING_SIZE];
+int num_download_mirrors = 0;
+
+BOOL add_download_mirror(const char *base_url) {
+    if (num_download_mirrors >= MAX_MIRRORS || !*base_url) return FALSE;
+
+    char *mirror = download_mirrors[num_download_mirrors++];
+    strncpy(mirror, base_url, STRING_SIZE - 1);
+    mirror[STRING_SIZE - 1] = '\0';
+
+    size_t length = strlen(mirror);
+    if (length != 0 && mirror[length - 1] == '/') {
+        mirror[length - 1] = '\0';
+    }
+    return TRUE;
+}
+
+static char *memory_sink_reserve(byte_sink *sink, size_t *size) {
+    memory *mem = ((memory_sink *) sink)->mem;
+    if (mem->capacity - mem->size < *size) {
+        size_t capacity = max(mem->capacity * 2, mem->size + *size);
+        char *data = (char *) realloc(mem->data, capacity);
+        if (!data) return NULL;
+        mem->data = data;
+        mem->capacity = capacity;
+    }
+    *size = mem->capacity - mem->size;
+    return mem->data + mem->size;
+}
+
+static int memory_sink_commit(byte_sink *sink, const char *data, size_t nbytes) {
+    ((memory_sink *) sink)->mem->size += nbytes;
+    return error_ok;
+}
+
+void memory_sink_init(memory_sink *sink, memory *mem) {
+    sink->base.reserve = memory_sink_reserve;
+    sink->base.commit = memory_sink_commit;
+    sink->mem = mem;
+}
+
+static char *file_sink_reserve(byte_sink *sink, size_t *size) {
+    *size = min(*size, FILE_SINK_BUFFER_SIZE);
+    return ((file_sink *) sink)->buffer;
+}
+
+static int file_sink_commit(byte_sink *sink, const char *data, size_t nbytes) {
+    return fwrite(data, 1, nbytes, ((file_sink *) sink)->file_out) == nbytes ? error_ok : error_cant_write_file;
+}
+
+BOOL file_sink_init(file_sink *sink, FILE *file_out) {
+    sink->base.reserve = file_sink_reserve;
+    sink->base.commit = file_sink_commit;
+    sink->file_out = file_out;
+    sink->buffer = (char *) malloc(FILE_SINK_BUFFER_SIZE);
+    return sink->buffer != NULL;
+}
+
+void file_sink_free(file_sink *sink) {
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
+
+static char *mapped_sink_reserve(byte_sink *sink, size_t *size) {
+    mapped_sink *mapped = (mapped_sink *) sink;
+    *size = min(*size, mapped->size - mapped->pos);
+    return *size != 0 ? mapped->data + mapped->pos : NULL;
+}
+
+static int mapped_sink_commit(byte_sink *sink, const char *data, size_t nbytes) {
+    ((mapped_sink *) sink)->pos += nbytes;
+    return error_ok;
+}
+
+void mapped_sink_init(mapped_sink *sink, char *data, size_t size) {
+    sink->base.reserve = mapped_sink_reserve;
+    sink->base.commit = mapped_sink_commit;
+    sink->data = data;
+    sink->size = size;
+    sink->pos = 0;
+}
+
+static char *tee_sink_reserve(byte_sink *sink, size_t *size) {
+    tee_sink *tee = (tee_sink *) sink;
+    return tee->target->reserve(tee->target, size);
+}
+
+static int tee_sink_commit(byte_sink *sink, const char *data, size_t nbytes) {
+    tee_sink *tee = (tee_sink *) sink;
+    tee->observer(tee->context, data, nbytes);
+    return tee->target->commit(tee->target, data, nbytes);
+}
+
+void sha256_observer(void *context, const char *data, size_t nbytes) {
+    sha256_update((sha256_context *) context, data, nbytes);
+}
+
+void tee_sink_init(tee_sink *sink, byte_sink *target, sink_observer observer, void *context) {
+    sink->base.reserve = tee_sink_reserve;
+    sink->base.commit = tee_sink_commit;
+    sink->target = target;
+    sink->observer = observer;
+    sink->context = context;
+}
+
+// fails the transfer with error_too_slow when its throughput drops, so that it can go on from another endpoint.
+// it only watches when there is another endpoint to go to
+typedef struct {
+    byte_sink base;
+    byte_sink *target;
+    BOOL enabled;
+    double window_start;
+    size_t window_bytes;
+    double best_rate;
+} rate_watch_sink;
+
+static char *rate_watch_sink_reserve(byte_sink *sink, size_t *size) {
+    rate_watch_sink *watch = (rate_watch_sink *) sink;
+    return watch->target->reserve(watch->target, size);
+}
+
+// the chunk that shows the drop is not passed on, the transfer resumes from the last committed byte
+static int rate_watch_sink_commit(byte_sink *sink, const char *data, size_t nbytes) {
+    rate_watch_sink *watch = (rate_watch_sink *) sink;
+    if (watch->enabled) {
+        double now = get_time_seconds();
+        if (watch->window_start == 0) {
+            watch->window_start = now;
+        }
+        watch->window_bytes += nbytes;
+        if (now - watch->window_start >= MIRROR_RATE_WINDOW) {
+            double rate = watch->window_bytes / (now - watch->window_start);
+            if (rate < watch->best_rate * MIRROR_MIN_RATE_RATIO) {
+                return error_too_slow;
+            }
+            watch->best_rate = max(watch->best_rate, rate);
+            watch->window_start = now;
+            watch->window_bytes = 0;
+        }
+    }
+    return watch->target->commit(watch->target, data, nbytes);
+}
+
+static void rate_watch_sink_init(rate_watch_sink *sink, byte_sink *target, BOOL enabled) {
+    memset(sink, 0, sizeof(rate_watch_sink));
+    sink->base.reserve = rate_watch_sink_reserve;
+    sink->base.commit = rate_watch_sink_commit;
+    sink->target = target;
+    sink->enabled = enabled;
+}
+
+// holds each chunk back until the bytes received by all connections fit in the rate limit. the connection is not
+// read in the meantime, so the server is slowed down by flow control rather than the data being dropped.
+// it also stops the transfer once downloads are cancelled
+typedef struct {
+    byte_sink base;
+    byte_sink *target;
+} throttle_sink;
+
+static char *throttle_sink_reserve(byte_sink *sink, size_t *size) {
+    throttle_sink *throttle = (throttle_sink *) sink;
+    return throttle->target->reserve(throttle->target, size);
+}
+
+static int throttle_sink_commit(byte_sink *sink, const char *data, size_t nbytes) {
+    throttle_sink *throttle = (throttle_sink *) sink;
+    if (atomic_load(&downloads_cancelled)) {
+        return error_cancelled;
+    }
+    double limit = download_rate_limit;
+    if (limit > 0) {
+        unsigned long long bytes = atomic_fetch_add(&rate_limit_bytes, nbytes) + nbytes;
+        double delay = rate_limit_start + bytes / limit - get_time_seconds();
+        if (delay > 0) {
+            sleep_ms((int) (delay * 1000));
+        }
+    }
+    return throttle->target->commit(throttle->target, data, nbytes);
+}
+
+static void throttle_sink_init(throttle_sink *sink, byte_sink *target) {
+    memset(sink, 0, sizeof(throttle_sink));
+    sink->base.reserve = throttle_sink_reserve;
+    sink->base.commit = throttle_sink_commit;
+    sink->target = target;
+}
+
+// every request goes through here, so that it shows up in the trace along with its phases
+static int download_request(byte_sink *sink, const char *url, size_t download_size, const byte_range *range, const char *if_none_match, char *etag, downloading_callback callback, void *params) {
+    if (atomic_load(&downloads_cancelled)) {
+        return error_cancelled;
+    }
+    throttle_sink throttle;
+    throttle_sink_init(&throttle, sink);
+    sink = &throttle.base;
+
+    if (!trace_enabled()) {
+        return download_file_impl(&shared_session, sink, url, download_size, range, if_none_match, etag, callback, params, NULL);
+    }
+
+    http_timing timing;
+    double start = trace_begin();
+    int errcode = download_file_impl(&shared_session, sink, url, download_size, range, if_none_match, etag, callback, params, &timing);
+
+    double phase_start = start;
+    if (timing.dns_time >= 0) {
+        trace_span("http", "dns", phase_start, start + timing.dns_time, -1);
+        phase_start = start + timing.dns_time;
+    }
+    if (timing.connect_time >= 0) {
+        trace_span("http", "connect", phase_start, start + timing.connect_time, -1);
+        phase_start = start + timing.connect_time;
+    }
+    if (timing.first_byte_time >= 0) {
+        trace_span("http", "first byte", phase_start, start + timing.first_byte_time, -1);
+        phase_start = start + timing.first_byte_time;
+    }
+    trace_span("http", "transfer", phase_start, start + timing.total_time, timing.bytes_read);
+    trace_span("download", url, start, start + timing.total_time, timing.bytes_read);
+    return errcode;
+}
+
+static int download_file_to_memory(memory *mem, const char *url, size_t download_size, const char *if_none_match, char *etag, downloading_callback callback, void *params) {
+    memset(mem, 0, sizeof(memory));
+
+    memory_sink sink;
+    memory_sink_init(&sink, mem);
+
+    if (download_size != download_query_size) {
+        size_t reserved_size = download_size;
+        sink.base.reserve(&sink.base, &reserved_size);
+    }
+
+    int errcode = download_request(&sink.base, url, download_size, NULL, if_none_match, etag, callback, params);
+    if (errcode != error_ok) {
+        free(mem->data);
+        memset(mem, 0, sizeof(memory));
+    }
+    return errcode;
+}
+
+typedef struct {
+    const char *url;
+    size_t download_size;
+    memory data;
+    double time;
+    int errcode;
+} endpoint_probe;
+
+static int probe_endpoint_thread(void *param) {
+    endpoint_probe *probe = (endpoint_probe *) param;
+    memory_sink sink;
+    memory_sink_init(&sink, &probe->data);
+
+    byte_range range = { 0, min(probe->download_size, (size_t) MIRROR_PROBE_SIZE) };
+    double start = get_time_seconds();
+    probe->errcode = download_request(&sink.base, probe->url, probe->download_size, &range, NULL, NULL, NULL, NULL);
+    probe->time = get_time_seconds() - start;
+    return probe->errcode;
+}
+
+// the mirror url keeps the path of the asset url and replaces its scheme and host
+static BOOL make_mirror_url(char *dest, const char *mirror, const char *url) {
+    const char *host = strstr(url, "://");
+    const char *path = host ? strchr(host + 3, '/') : NULL;
+    if (!path) return FALSE;
+
+    snprintf(dest, STRING_SIZE, "%s%s", mirror, path);
+    return TRUE;
+}
+
+static void init_endpoints(endpoint_list *list, const char *url) {
+    memset(list, 0, sizeof(endpoint_list));
+    strncpy(list->urls[0], url, STRING_SIZE - 1);
+    list->num_urls = 1;
+}
+
+// the probes of all endpoints run at once and the endpoints are ranked by how long theirs took, which accounts
+// for both latency and throughput. a mirror that fails or serves other bytes than the origin is left out,
+// and the origin is kept as the last resort if its own probe failed
+void rank_endpoints(endpoint_list *list, const char *url, size_t download_size) {
+    init_endpoints(list, url);
+    if (num_download_mirrors == 0 || download_size == download_query_size || download_size == 0) return;
+
+    double start_time = get_time_seconds();
+    char urls[MAX_MIRRORS + 1][STRING_SIZE];
+    endpoint_probe probes[MAX_MIRRORS + 1];
+    int num_probes = 0;
+    strncpy(urls[num_probes++], url, STRING_SIZE);
+    for (int i=0; i<num_download_mirrors; ++i) {
+        if (make_mirror_url(urls[num_probes], download_mirrors[i], url)) {
+            ++num_probes;
+        }
+    }
+    for (int i=0; i<num_probes; ++i) {
+        memset(&probes[i], 0, sizeof(endpoint_probe));
+        probes[i].url = urls[i];
+        probes[i].download_size = download_size;
+        probes[i].errcode = error_cant_access_site;
+    }
+
+    thread_t threads[MAX_MIRRORS + 1];
+    BOOL started[MAX_MIRRORS + 1];
+    for (int i=1; i<num_probes; ++i) {
+        started[i] = thread_create(&threads[i], probe_endpoint_thread, &probes[i]);
+    }
+    probe_endpoint_thread(&probes[0]);
+    for (int i=1; i<num_probes; ++i) {
+        if (started[i]) {
+            thread_join(&threads[i]);
+        }
+    }
+
+    const endpoint_probe *origin = &probes[0];
+    list->num_urls = 0;
+    for (;;) {
+        int best = -1;
+        for (int i=0; i<num_probes; ++i) {
+            const endpoint_probe *probe = &probes[i];
+            if (probe->errcode != error_ok || probe->time < 0) continue;
+            if (origin->errcode == error_ok && (probe->data.size != origin->data.size || memcmp(probe->data.data, origin->data.data, origin->data.size) != 0)) continue;
+            if (best < 0 || probe->time < probes[best].time) {
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        strncpy(list->urls[list->num_urls++], urls[best], STRING_SIZE);
+        // taken out of the ranking
+        probes[best].time = -1;
+    }
+    if (origin->errcode != error_ok) {
+        strncpy(list->urls[list->num_urls++], url, STRING_SIZE);
+    }
+
+    for (int i=0; i<num_probes; ++i) {
+        free(probes[i].data.data);
+    }
+    trace_end("mirror", list->urls[0], start_time, -1);
+}
+
+int download_file(memory *mem, const char *url, size_t download_size, downloading_callback callback, void *params) {
+    return download_file_to_memory(mem, url, download_size, NULL, NULL, callback, params);
+}
+
+int download_file_conditional(memory *mem, const char *url, const char *if_none_match, char *etag) {
+    return download_file_to_memory(mem, url, download_query_size, if_none_match, etag, NULL, NULL);
+}
+
+// a journal is kept next to each partially downloaded file, so that an interrupted download
+// can be continued with a range request instead of starting over
+typedef struct {
+    char url[STRING_SIZE];
+    size_t size;
+    // the file is complete up to this offset
+    size_t bytes_done;
+    char etag[STRING_SIZE];
+    // what is left of each connection of a segmented download, the output already has its full size then.
+    // a range that starts before bytes_done was overwritten by a single stream and continues from bytes_done
+    int num_segments;
+    byte_range segments[MAX_DOWNLOAD_SEGMENTS];
+} download_journal;
+
+static BOOL read_journal(const char *journal_path, download_journal *journal) {
+    memset(journal, 0, sizeof(download_journal));
+
+    FILE *file_in = fopen(journal_path, "r");
+    if (!file_in) return FALSE;
+
+    char line[STRING_SIZE];
+    unsigned long long size, bytes_done;
+    BOOL ret = fgets(journal->url, STRING_SIZE, file_in)
+        && fgets(line, STRING_SIZE, file_in) && sscanf(line, "%llu", &size) == 1
+        && fgets(line, STRING_SIZE, file_in) && sscanf(line, "%llu", &bytes_done) == 1;
+    if (ret) {
+        journal->url[strcspn(journal->url, "\n")] = '\0';
+        journal->size = size;
+        journal->bytes_done = bytes_done;
+        if (fgets(journal->etag, STRING_SIZE, file_in)) {
+            journal->etag[strcspn(journal->etag, "\n")] = '\0';
+        }
+
+        unsigned long long begin, end, previous_end = 0;
+        while (fgets(line, STRING_SIZE, file_in) && sscanf(line, "%llu %llu", &begin, &end) == 2) {
+            if (journal->num_segments == MAX_DOWNLOAD_SEGMENTS || begin > end || end > size || end < previous_end) {
+                ret = FALSE;
+                break;
+            }
+            journal->segments[journal->num_segments].begin = begin;
+            journal->segments[journal->num_segments].end = end;
+            ++journal->num_segments;
+            previous_end = end;
+        }
+    }
+    fclose(file_in);
+    return ret;
+}
+
+static void write_journal(const char *journal_path, const download_journal *journal) {
+    FILE *file_out = fopen(journal_path, "w");
+    if (file_out) {
+        fprintf(file_out, "%s\n%llu\n%llu\n%s\n", journal->url,
+            (unsigned long long) journal->size, (unsigned long long) journal->bytes_done, journal->etag);
+        for (int i=0; i<journal->num_segments; ++i) {
+            fprintf(file_out, "%llu %llu\n", (unsigned long long) journal->segments[i].begin, (unsigned long long) journal->segments[i].end);
+        }
+        fclose(file_out);
+    }
+}
+
+typedef struct {
+    FILE *file_out;
+    const char *journal_path;
+    download_journal *journal;
+    size_t last_saved;
+    downloading_callback callback;
+    void *params;
+} journal_writer;
+
+static void journal_callback(int bytes_read, int bytes_total, void *params) {
+    journal_writer *writer = (journal_writer *) params;
+    writer->journal->bytes_done = bytes_read;
+
+    if (writer->journal->bytes_done < writer->last_saved
+        || writer->journal->bytes_done - writer->last_saved >= JOURNAL_INTERVAL) {
+        // the journal must never claim more bytes than what is on disk
+        fflush(writer->file_out);
+        write_journal(writer->journal_path, writer->journal);
+        writer->last_saved = writer->journal->bytes_done;
+    }
+
+    if (writer->callback) {
+        writer->callback(bytes_read, bytes_total, writer->params);
+    }
+}
+
+typedef struct segmented_download segmented_download;
+
+typedef struct {
+    segmented_download *download;
+    // the part left to download when the request starts
+    byte_range range;
+    // end of what was written so far
+    atomic_size_t pos;
+    // the etag is that of this endpoint
+    int endpoint;
+    char etag[STRING_SIZE];
+} download_segment;
+
+struct segmented_download {
+    // the segments move on to the next endpoint together, as the connections of download_ranges do
+    const endpoint_list *endpoints;
+    atomic_int endpoint;
+    char *data;
+    const char *journal_path;
+    download_journal *journal;
+    download_segment segments[MAX_DOWNLOAD_SEGMENTS];
+    int num_segments;
+    // set while the first segment runs alone, its etag is not in the journal yet
+    BOOL first_alone;
+    // the threads of the other segments, started by the first one
+    thread_t threads[MAX_DOWNLOAD_SEGMENTS];
+    int num_threads;
+    BOOL others_started;
+    int start_errcode;
+    atomic_size_t total_bytes_done;
+    atomic_size_t last_saved;
+    atomic_int saving;
+    downloading_callback callback;
+    void *params;
+};
+
+// stores where each connection is into the journal, the completed prefix goes into bytes_done
+static void save_segments(segmented_download *download) {
+    download_journal *journal = download->journal;
+    if (download->first_alone) {
+        strncpy(journal->etag, download->segments[0].etag, STRING_SIZE - 1);
+    }
+    journal->bytes_done = journal->size;
+    journal->num_segments = download->num_segments;
+    for (int i=0; i<download->num_segments; ++i) {
+        byte_range *range = &journal->segments[i];
+        range->begin = atomic_load(&download->segments[i].pos);
+        range->end = download->segments[i].range.end;
+        if (range->begin != range->end && journal->bytes_done == journal->size) {
+            journal->bytes_done = range->begin;
+        }
+    }
+    write_journal(download->journal_path, journal);
+}
+
+static int download_segment_thread(void *param);
+
+// the other segments check that they get the same version of the file as the first one
+static void start_other_segments(segmented_download *download) {
+    if (download->first_alone) {
+        strncpy(download->journal->etag, download->segments[0].etag, STRING_SIZE - 1);
+        for (int i=1; i<download->num_segments; ++i) {
+            strncpy(download->segments[i].etag, download->journal->etag, STRING_SIZE - 1);
+            download->segments[i].endpoint = download->segments[0].endpoint;
+        }
+        download->first_alone = FALSE;
+    }
+    download->others_started = TRUE;
+    for (int i=1; i<download->num_segments; ++i) {
+        if (!thread_create(&download->threads[download->num_threads], download_segment_thread, &download->segments[i])) {
+            download->start_errcode = error_cant_access_site;
+            break;
+        }
+        ++download->num_threads;
+    }
+}
+
+static void download_segment_callback(int bytes_read, int bytes_total, void *params) {
+    download_segment *segment = (download_segment *) params;
+    segmented_download *download = segment->download;
+
+    // bytes only reach the sink once the server answered the range with 206, the others can start
+    if (segment == &download->segments[0] && !download->others_started) {
+        start_other_segments(download);
+    }
+
+    size_t delta = (size_t) bytes_read - atomic_exchange(&segment->pos, (size_t) bytes_read);
+    size_t total = atomic_fetch_add(&download->total_bytes_done, delta) + delta;
+
+    // the connections take turns writing the journal, the one that finds it busy leaves it to the other
+    if (total - atomic_load(&download->last_saved) >= JOURNAL_INTERVAL && !atomic_exchange(&download->saving, TRUE)) {
+        atomic_store(&download->last_saved, total);
+        save_segments(download);
+        atomic_store(&download->saving, FALSE);
+    }
+
+    if (download->callback) {
+        download->callback(total, download->journal->size, download->params);
+    }
+}
+
+// a segment that slows down or fails goes on from where it is on the next endpoint
+static int download_segment_thread(void *param) {
+    download_segment *segment = (download_segment *) param;
+    segmented_download *download = segment->download;
+    for (;;) {
+        byte_range range = { atomic_load(&segment->pos), segment->range.end };
+        if (range.begin == range.end) return error_ok;
+
+        int endpoint = atomic_load(&download->endpoint);
+        BOOL can_fail_over = endpoint + 1 < download->endpoints->num_urls;
+        // the etag of another endpoint does not apply, the digest guards the file then
+        if (endpoint != segment->endpoint) {
+            *segment->etag = '\0';
+            segment->endpoint = endpoint;
+        }
+
+        mapped_sink sink;
+        mapped_sink_init(&sink, download->data + range.begin, range.end - range.begin);
+        rate_watch_sink watch;
+        rate_watch_sink_init(&watch, &sink.base, can_fail_over);
+
+        int errcode = download_request(&watch.base, download->endpoints->urls[endpoint], download->journal->size, &range, NULL, segment->etag, download_segment_callback, segment);
+        if ((errcode == error_too_slow || errcode == error_cant_access_site) && can_fail_over) {
+            // all the segments move on to the next endpoint
+            atomic_compare_exchange_strong(&download->endpoint, &endpoint, endpoint + 1);
+            continue;
+        }
+        return errcode;
+    }
+}
+
+// splits the file in byte ranges and downloads them on parallel connections, each writing at its own offset
+// in the preallocated output. if the journal already has segments they are continued in the existing file,
+// otherwise the file is split in num_segments. the journal is saved as they progress, and on failure it holds
+// the position of each one and the completed prefix in bytes_done.
+// segments arrive out of order, so if hasher is not NULL the output is hashed from the mapped view once complete.
+// endpoint is the index of the endpoint to start from, and where the segments ended up on return
+static int download_file_segmented(const char *filename, const endpoint_list *endpoints, int *endpoint, int num_segments, download_journal *journal, const char *journal_path, sha256_context *hasher, downloading_callback callback, void *params) {
+    size_t download_size = journal->size;
+    BOOL resuming = journal->num_segments != 0;
+
+    mapped_file output;
+    if (!map_output_file(&output, filename, download_size, resuming)) {
+        unmap_output_file(&output);
+        return error_cant_write_file;
+    }
+    if (!resuming) {
+        preallocate_output_file(&output);
+    }
+
+    segmented_download *download = (segmented_download *) calloc(1, sizeof(segmented_download));
+    if (!download) {
+        unmap_output_file(&output);
+        return error_cant_write_file;
+    }
+    download->endpoints = endpoints;
+    atomic_store(&download->endpoint, *endpoint);
+    download->data = output.view;
+    download->journal_path = journal_path;
+    download->journal = journal;
+    download->num_segments = resuming ? journal->num_segments : num_segments;
+    download->first_alone = !resuming;
+    download->callback = callback;
+    download->params = params;
+
+    size_t segment_size = download_size / num_segments;
+    size_t bytes_left = 0;
+    for (int i=0; i<download->num_segments; ++i) {
+        download_segment *segment = &download->segments[i];
+        segment->download = download;
+        segment->endpoint = *endpoint;
+        if (resuming) {
+            segment->range.end = journal->segments[i].end;
+            segment->range.begin = max(journal->segments[i].begin, min(journal->bytes_done, segment->range.end));
+            strncpy(segment->etag, journal->etag, STRING_SIZE - 1);
+        } else {
+            segment->range.begin = i * segment_size;
+            segment->range.end = i == num_segments - 1 ? download_size : (i + 1) * segment_size;
+        }
+        atomic_store(&segment->pos, segment->range.begin);
+        bytes_left += segment->range.end - segment->range.begin;
+    }
+    atomic_store(&download->total_bytes_done, download_size - bytes_left);
+    atomic_store(&download->last_saved, download_size - bytes_left);
+
+    // a server which ignores ranges is detected with a single request: the first segment starts the others once
+    // its response is a 206, and keeps going alongside them. a resumed download already knows that it is served
+    if (resuming) {
+        start_other_segments(download);
+    }
+    int errcode = download_segment_thread(&download->segments[0]);
+    if (errcode == error_ok && !download->others_started) {
+        start_other_segments(download);
+    }
+    for (int i=0; i<download->num_threads; ++i) {
+        int thread_result = thread_join(&download->threads[i]);
+        if (thread_result != error_ok && errcode == error_ok) {
+            errcode = thread_result;
+        }
+    }
+    if (download->start_errcode != error_ok && errcode == error_ok) {
+        errcode = download->start_errcode;
+    }
+    if (errcode == error_ok && hasher) {
+        sha256_update(hasher, output.view, download_size);
+    }
+    unmap_output_file(&output);
+
+    if (errcode != error_ok) {
+        save_segments(download);
+    }
+    *endpoint = atomic_load(&download->endpoint);
+    free(download);
+    return errcode;
+}
+
+typedef struct {
+    const endpoint_list *endpoints;
+    atomic_int endpoint;
+    size_t download_size;
+    char *data;
+    const byte_range *ranges;
+    int num_ranges;
+    atomic_int next_range;
+    atomic_int errcode;
+    atomic_size_t total_bytes_done;
+    downloading_callback callback;
+    void *params;
+} range_download;
+
+typedef struct {
+    range_download *download;
+    size_t begin;
+    size_t bytes_done;
+} range_worker;
+
+static void download_range_callback(int bytes_read, int bytes_total, void *params) {
+    range_worker *worker = (range_worker *) params;
+    range_download *download = worker->download;
+    size_t bytes_done = bytes_read - worker->begin;
+    size_t total = atomic_fetch_add(&download->total_bytes_done, bytes_done - worker->bytes_done) + (bytes_done - worker->bytes_done);
+    worker->bytes_done = bytes_done;
+
+    if (download->callback) {
+        download->callback(total, download->download_size, download->params);
+    }
+}
+
+// each connection takes the next range from the shared list until it is empty
+static int download_range_thread(void *param) {
+    range_download *download = (range_download *) param;
+    range_worker worker = { download, 0, 0 };
+
+    int i;
+    while (atomic_load(&download->errcode) == error_ok && (i = atomic_fetch_add(&download->next_range, 1)) < download->num_ranges) {
+        const byte_range *range = &download->ranges[i];
+        worker.begin = range->begin;
+        worker.bytes_done = 0;
+
+        int errcode;
+        for (int attempt = 0; ; ++attempt) {
+            int endpoint = atomic_load(&download->endpoint);
+            BOOL can_fail_over = endpoint + 1 < download->endpoints->num_urls;
+
+            mapped_sink sink;
+            mapped_sink_init(&sink, download->data + range->begin, range->end - range->begin);
+            rate_watch_sink watch;
+            rate_watch_sink_init(&watch, &sink.base, can_fail_over);
+
+            // a retried range starts over, so its progress is taken back
+            if (attempt != 0) {
+                download_range_callback(range->begin, download->download_size, &worker);
+            }
+            errcode = download_request(&watch.base, download->endpoints->urls[endpoint], download->download_size, range, NULL, NULL, download_range_callback, &worker);
+            if ((errcode == error_too_slow || errcode == error_cant_access_site) && can_fail_over) {
+                // all the connections move on to the next endpoint
+                atomic_compare_exchange_strong(&download->endpoint, &endpoint, endpoint + 1);
+                continue;
+            }
+            if (errcode != error_cant_access_site || attempt >= DOWNLOAD_RETRIES) break;
+            sleep_ms(1000);
+        }
+        if (errcode != error_ok) {
+            atomic_store(&download->errcode, errcode);
+        }
+    }
+    return atomic_load(&download->errcode);
+}
+
+int download_ranges(char *data, const endpoint_list *endpoints, size_t download_size, const byte_range *ranges, int num_ranges, downloading_callback callback, void *params) {
+    if (num_ranges == 0) return error_ok;
+
+    range_download download;
+    memset(&download, 0, sizeof(download));
+    download.endpoints = endpoints;
+    download.download_size = download_size;
+    download.data = data;
+    download.ranges = ranges;
+    download.num_ranges = num_ranges;
+    download.callback = callback;
+    download.params = params;
+
+    int num_connections = max(min(min(download_segments, MAX_DOWNLOAD_SEGMENTS), num_ranges), 1);
+
+    thread_t threads[MAX_DOWNLOAD_SEGMENTS];
+    int num_threads = 0;
+    for (int i=1; i<num_connections; ++i) {
+        if (thread_create(&threads[num_threads], download_range_thread, &download)) {
+            ++num_threads;
+        }
+    }
+    download_range_thread(&download);
+
+    for (int i=0; i<num_threads; ++i) {
+        thread_join(&threads[i]);
+    }
+    return atomic_load(&download.errcode);
+}
+
+static BOOL sha256_update_from_file(sha256_context *ctx, const char *filename, size_t nbytes) {
+    FILE *file_in = fopen(filename, "rb");
+    if (!file_in) return FALSE;
+
+    char *buffer = (char *) malloc(FILE_SINK_BUFFER_SIZE);
+    while (buffer && nbytes != 0) {
+        size_t nread = fread(buffer, 1, min(nbytes, FILE_SINK_BUFFER_SIZE), file_in);
+        if (nread == 0) break;
+        sha256_update(ctx, buffer, nread);
+        nbytes -= nread;
+    }
+    free(buffer);
+    fclose(file_in);
+    return nbytes == 0;
+}
+
+int download_file_to_disk(const char *filename, const char *url, size_t download_size, const char *expected_sha256, char *sha256, downloading_callback callback, void *params) {
+    char journal_path[MAX_PATH];
+    snprintf(journal_path, MAX_PATH, "%s.journal", filename);
+
+    int errcode = error_ok;
+    FILE *file_out = NULL;
+    file_sink sink = {0};
+
+    sha256_context hasher;
+    BOOL hashing = sha256_init(&hasher);
+
+    endpoint_list endpoints;
+    if (hashing && expected_sha256 && *expected_sha256) {
+        rank_endpoints(&endpoints, url, download_size);
+    } else {
+        init_endpoints(&endpoints, url);
+    }
+    int endpoint = 0;
+
+    download_journal journal;
+    BOOL resuming = download_size != download_query_size
+        && read_journal(journal_path, &journal)
+        && strcmp(journal.url, url) == 0
+        && journal.size == download_size
+        && journal.bytes_done < download_size
+        && get_file_size(filename) >= (journal.num_segments != 0 ? download_size : journal.bytes_done);
+    if (resuming) {
+        // the etag may come from another endpoint, the digest is what guards the resumed file then
+        if (endpoints.num_urls > 1) {
+            *journal.etag = '\0';
+        }
+    } else {
+        memset(&journal, 0, sizeof(journal));
+        strncpy(journal.url, url, STRING_SIZE - 1);
+        journal.size = download_size;
+    }
+
+    int num_segments = min(download_segments, MAX_DOWNLOAD_SEGMENTS);
+    if (journal.num_segments != 0
+        || (!resuming && download_size != download_query_size && num_segments > 1 && download_size >= num_segments * MIN_SEGMENT_SIZE))
+    {
+        errcode = download_file_segmented(filename, &endpoints, &endpoint, num_segments, &journal, journal_path, hashing ? &hasher : NULL, callback, params);
+        if (errcode == error_ok || errcode == error_cancelled) {
+            goto finish;
+        }
+        // otherwise continue on a single connection, from what was already downloaded if the server supports ranges.
+        // the segments stay in the journal, the single stream only overwrites the part before journal.bytes_done.
+        // it goes on from the endpoint the segments ended up on, the etag of the first one does not apply there
+        if (endpoint != 0) {
+            *journal.etag = '\0';
+        }
+        if (errcode == error_range_ignored) {
+            journal.bytes_done = 0;
+        }
+        errcode = error_ok;
+    }
+    if (journal.bytes_done != 0) {
+        file_out = fopen(filename, "r+b");
+        if (file_out && !seek_file(file_out, journal.bytes_done)) {
+            fclose(file_out);
+            file_out = NULL;
+        }
+    }
+    if (!file_out) {
+        journal.bytes_done = 0;
+        journal.num_segments = 0;
+        file_out = fopen(filename, "wb");
+        if (file_out && download_size != download_query_size) {
+            preallocate_file(file_out, download_size);
+        }
+    }
+    if (!file_out || !file_sink_init(&sink, file_out)) {
+        errcode = error_cant_write_file;
+        goto finish;
+    }
+
+    // only the part downloaded by a previous attempt is read back from disk, the rest is hashed as it arrives
+    if (hashing && journal.bytes_done != 0 && !sha256_update_from_file(&hasher, filename, journal.bytes_done)) {
+        sha256_free(&hasher);
+        hashing = FALSE;
+    }
+
+    journal_writer writer = { file_out, journal_path, &journal, journal.bytes_done, callback, params };
+
+    tee_sink tee;
+    tee_sink_init(&tee, &sink.base, sha256_observer, &hasher);
+
+    for (int attempt = 0; ; ++attempt) {
+        BOOL can_fail_over = endpoint + 1 < endpoints.num_urls;
+        rate_watch_sink watch;
+        rate_watch_sink_init(&watch, hashing ? &tee.base : &sink.base, can_fail_over);
+
+        byte_range range = { journal.bytes_done, download_size };
+        errcode = download_request(&watch.base, endpoints.urls[endpoint], download_size, journal.bytes_done != 0 ? &range : NULL, NULL, journal.etag, journal_callback, &writer);
+        if ((errcode == error_too_slow || errcode == error_cant_access_site) && can_fail_over) {
+            // the rest of the file comes from the next endpoint, the etag of the previous one does not apply to it
+            ++endpoint;
+            *journal.etag = '\0';
+            fflush(file_out);
+            write_journal(journal_path, &journal);
+            continue;
+        }
+        if (errcode == error_range_ignored) {
+            // the server ignored the range or the file changed, start over
+            if (!seek_file(file_out, 0)) {
+                errcode = error_cant_write_file;
+                break;
+            }
+            journal.bytes_done = 0;
+            journal.num_segments = 0;
+            if (hashing) {
+                sha256_free(&hasher);
+                hashing = sha256_init(&hasher);
+            }
+            continue;
+        }
+        if (errcode != error_cant_access_site || attempt >= DOWNLOAD_RETRIES) break;
+
+        fflush(file_out);
+        write_journal(journal_path, &journal);
+        sleep_ms(1000);
+    }
+
+finish:
+    file_sink_free(&sink);
+    if (file_out && fclose(file_out) != 0 && errcode == error_ok) {
+        errcode = error_cant_write_file;
+    }
+
+    if (errcode == error_ok) {
+        remove_file(journal_path);
+
+        char digest[SHA256_HEX_SIZE] = {0};
+        if (hashing) {
+            sha256_final_hex(&hasher, digest);
+        }
+        if (sha256) {
+            strncpy(sha256, digest, SHA256_HEX_SIZE);
+        }
+        if (hashing && expected_sha256 && *expected_sha256 && _stricmp(digest, expected_sha256) != 0) {
+            remove_file(filename);
+            errcode = error_checksum_mismatch;
+        }
+    } else {
+        write_journal(journal_path, &journal);
+    }
+
+    if (hashing) {
+        sha256_free(&hasher);
+    }
+    return errcode;
+}
+
@@ -0,0 +1,118 @@
+#ifndef __DOWNLOAD_H__
+#define __DOWNLOAD_H__
+
+#include "sys.h"
+
+#define JOURNAL_INTERVAL (256 * 1024)
+#define DOWNLOAD_RETRIES 3
+
+#ifndef DOWNLOAD_SEGMENTS
+#define DOWNLOAD_SEGMENTS 4
+#endif
+#define MAX_DOWNLOAD_SEGMENTS 16
+#define MIN_SEGMENT_SIZE (1024 * 1024)
+
+// mirrors serve the release assets under the same path as the origin, for instance
+// http://mirror.local/owner/repo/releases/download/tag/update.zip for a github asset url
+#define MAX_MIRRORS 8
+
+// the first bytes of an asset are fetched from the origin and from every mirror at once, the fastest one is used
+#define MIRROR_PROBE_SIZE (64 * 1024)
+
+// a transfer moves on to the next endpoint when its throughput over MIRROR_RATE_WINDOW seconds
+// falls below MIRROR_MIN_RATE_RATIO of the best window so far
+#define MIRROR_RATE_WINDOW 2.0
+#define MIRROR_MIN_RATE_RATIO 0.25
+
+// grows the buffer geometrically, so that responses of unknown size are not copied on every chunk
+typedef struct {
+    byte_sink base;
+    memory *mem;
+} memory_sink;
+
+void memory_sink_init(memory_sink *sink, memory *mem);
+
+typedef struct {
+    byte_sink base;
+    FILE *file_out;
+    char *buffer;
+} file_sink;
+
+BOOL file_sink_init(file_sink *sink, FILE *file_out);
+void file_sink_free(file_sink *sink);
+
+// writes into a fixed region, such as a view of a memory mapped file
+typedef struct {
+    byte_sink base;
+    char *data;
+    size_t size;
+    size_t pos;
+} mapped_sink;
+
+void mapped_sink_init(mapped_sink *sink, char *data, size_t size);
+
+// shows every chunk to an observer (a hasher or a decoder) before passing it on to the target sink
+typedef void (*sink_observer) (void *context, const char *data, size_t nbytes);
+
+typedef struct {
+    byte_sink base;
+    byte_sink *target;
+    sink_observer observer;
+    void *context;
+} tee_sink;
+
+void tee_sink_init(tee_sink *sink, byte_sink *target, sink_observer observer, void *context);
+
+void sha256_observer(void *context, const char *data, size_t nbytes);
+
+// every request goes through this session, it is opened once at startup with http_config
+extern http_session_config http_config;
+extern http_session shared_session;
+
+// number of parallel connections used for files of known size, can be changed at startup
+extern int download_segments;
+
+// total throughput of all transfers in bytes per second, 0 for no limit. it is meant for downloads that run
+// in the background, the budget starts over when the limit is set
+extern double download_rate_limit;
+
+void set_download_rate_limit(double bytes_per_second);
+
+// the transfers in progress and all the following ones fail with error_cancelled, for background downloads
+// that must stop before the process exits
+void cancel_downloads();
+
+// base urls of the mirrors, added at startup
+extern char download_mirrors[MAX_MIRRORS][STRING_SIZE];
+extern int num_download_mirrors;
+
+BOOL add_download_mirror(const char *base_url);
+
+// the origin and the mirrors of an asset, fastest first
+typedef struct {
+    char urls[MAX_MIRRORS + 1][STRING_SIZE];
+    int num_urls;
+} endpoint_list;
+
+// probes the first bytes of url from the origin and every mirror at once, and ranks them by how long it took.
+// the probes cost a request per endpoint, so an asset is ranked once for all its transfers
+void rank_endpoints(endpoint_list *list, const char *url, size_t download_size);
+
+int download_file(memory *mem, const char *url, size_t download_size, downloading_callback callback, void *params);
+
+// sends If-None-Match with the ETag from a previous response, returns error_not_modified if it is still current.
+// the ETag of the new response is stored in etag
+int download_file_conditional(memory *mem, const char *url, const char *if_none_match, char *etag);
+
+// on failure the partial file and its journal are left in place, and the next call resumes from them.
+// the SHA-256 of the data is computed while it is downloaded and stored in sha256 if it is not NULL;
+// if expected_sha256 is not empty and does not match, the file is deleted and error_checksum_mismatch is returned.
+// mirrors are only raced for files with an expected digest, since a transfer can be continued from another endpoint
+int download_file_to_disk(const char *filename, const char *url, size_t download_size, const char *expected_sha256, char *sha256, downloading_callback callback, void *params);
+
+// downloads the given ranges of the asset into the same offsets of data, which holds the whole file of download_size bytes.
+// ranges are shared between up to download_segments connections, the callback gets the number of bytes of all ranges.
+// the caller checks what was downloaded, so the ranges can come from any endpoint ranked by rank_endpoints
+int download_ranges(char *data, const endpoint_list *endpoints, size_t download_size, const byte_range *ranges, int num_ranges, downloading_callback callback, void *params);
+
+#endif
@@ -0,0 +1,225 @@
+#include "json_reader.h"
+
+#define MAX_NUMBER_SIZE 64
+
+void json_reader_init(json_reader *reader, const char *data, size_t size) {
+    memset(reader, 0, sizeof(json_reader));
+    reader->data = data;
+    reader->size = size;
+}
+
+static int json_error(json_reader *reader) {
+    reader->pos = reader->size;
+    reader->type = JSON_ERROR;
+    return JSON_ERROR;
+}
+
+int json_next(json_reader *reader) {
+    if (reader->type == JSON_ERROR) {
+        return JSON_ERROR;
+    }
+
+    const char *data = reader->data;
+    while (reader->pos < reader->size) {
+        char c = data[reader->pos];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ':') {
+            ++reader->pos;
+        } else {
+            break;
+        }
+    }
+    if (reader->pos >= reader->size) {
+        reader->type = JSON_END;
+        return JSON_END;
+    }
+
+    size_t begin = reader->pos;
+    char c = data[reader->pos++];
+    reader->value = data + begin;
+    reader->value_size = 1;
+    switch (c) {
+    case '{': reader->type = JSON_OBJECT_BEGIN; break;
+    case '}': reader->type = JSON_OBJECT_END; break;
+    case '[': reader->type = JSON_ARRAY_BEGIN; break;
+    case ']': reader->type = JSON_ARRAY_END; break;
+    case '"':
+        // escapes are only skipped here, they are resolved when the string is copied
+        while (reader->pos < reader->size && data[reader->pos] != '"') {
+            reader->pos += data[reader->pos] == '\\' ? 2 : 1;
+        }
+        if (reader->pos >= reader->size) {
+            return json_error(reader);
+        }
+        reader->type = JSON_STRING;
+        reader->value = data + begin + 1;
+        reader->value_size = reader->pos - begin - 1;
+        ++reader->pos;
+        break;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            reader->type = JSON_NUMBER;
+            while (reader->pos < reader->size && data[reader->pos] && strchr("+-.eE0123456789", data[reader->pos])) {
+                ++reader->pos;
+            }
+        } else if (c >= 'a' && c <= 'z') {
+            reader->type = JSON_LITERAL;
+            while (reader->pos < reader->size && data[reader->pos] >= 'a' && data[reader->pos] <= 'z') {
+                ++reader->pos;
+            }
+        } else {
+            return json_error(reader);
+        }
+        reader->value_size = reader->pos - begin;
+        break;
+    }
+    return reader->type;
+}
+
+BOOL json_skip_value(json_reader *reader) {
+    int depth = 0;
+    for (;;) {
+        switch (reader->type) {
+        case JSON_OBJECT_BEGIN:
+        case JSON_ARRAY_BEGIN:
+            ++depth;
+            break;
+        case JSON_OBJECT_END:
+        case JSON_ARRAY_END:
+            --depth;
+            break;
+        case JSON_ERROR:
+        case JSON_END:
+            return FALSE;
+        }
+        if (depth <= 0) {
+            return depth == 0;
+        }
+        json_next(reader);
+    }
+}
+
+BOOL json_next_member(json_reader *reader) {
+    int type = json_next(reader);
+    if (type == JSON_STRING) {
+        return TRUE;
+    }
+    if (type != JSON_OBJECT_END) {
+        json_error(reader);
+    }
+    return FALSE;
+}
+
+BOOL json_skip_member(json_reader *reader) {
+    json_next(reader);
+    return json_skip_value(reader);
+}
+
+BOOL json_string_equals(const json_reader *reader, const char *str) {
+    return reader->type == JSON_STRING && strlen(str) == reader->value_size
+        && memcmp(reader->value, str, reader->value_size) == 0;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static unsigned int read_hex4(const char *str, const char *end) {
+    unsigned int value = 0;
+    for (int i=0; i<4; ++i) {
+        int digit = str + i < end ? hex_digit(str[i]) : -1;
+        if (digit < 0) return 0xfffd;
+        value = (value << 4) | digit;
+    }
+    return value;
+}
+
+// the string is truncated to fit in size bytes, including the terminator
+BOOL json_read_string(json_reader *reader, char *dest, size_t size) {
+    int type = json_next(reader);
+    if (type != JSON_STRING && type != JSON_NUMBER) {
+        json_skip_value(reader);
+        return FALSE;
+    }
+
+    const char *str = reader->value;
+    const char *end = str + reader->value_size;
+    size_t length = 0;
+    while (str < end && length + 1 < size) {
+        if (*str != '\\' || str + 1 >= end) {
+            dest[length++] = *str++;
+            continue;
+        }
+        char c = str[1];
+        str += 2;
+        switch (c) {
+        case 'b': dest[length++] = '\b'; break;
+        case 'f': dest[length++] = '\f'; break;
+        case 'n': dest[length++] = '\n'; break;
+        case 'r': dest[length++] = '\r'; break;
+        case 't': dest[length++] = '\t'; break;
+        case 'u': {
+            unsigned int code = read_hex4(str, end);
+            str = min(str + 4, end);
+            if (code >= 0xd800 && code < 0xdc00 && str + 1 < end && str[0] == '\\' && str[1] == 'u') {
+                unsigned int low = read_hex4(str + 2, end);
+                if (low >= 0xdc00 && low < 0xe000) {
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    str = min(str + 6, end);
+                }
+            }
+            // encoded as utf-8, only if it fits whole
+            char utf8[4];
+            size_t utf8_size;
+            if (code < 0x80) {
+                utf8[0] = (char) code;
+                utf8_size = 1;
+            } else if (code < 0x800) {
+                utf8[0] = (char) (0xc0 | (code >> 6));
+                utf8[1] = (char) (0x80 | (code & 0x3f));
+                utf8_size = 2;
+            } else if (code < 0x10000) {
+                utf8[0] = (char) (0xe0 | (code >> 12));
+                utf8[1] = (char) (0x80 | ((code >> 6) & 0x3f));
+                utf8[2] = (char) (0x80 | (code & 0x3f));
+                utf8_size = 3;
+            } else {
+                utf8[0] = (char) (0xf0 | (code >> 18));
+                utf8[1] = (char) (0x80 | ((code >> 12) & 0x3f));
+                utf8[2] = (char) (0x80 | ((code >> 6) & 0x3f));
+                utf8[3] = (char) (0x80 | (code & 0x3f));
+                utf8_size = 4;
+            }
+            if (length + utf8_size + 1 > size) {
+                str = end;
+                break;
+            }
+            memcpy(dest + length, utf8, utf8_size);
+            length += utf8_size;
+            break;
+        }
+        default:
+            dest[length++] = c;
+            break;
+        }
+    }
+    dest[length] = '\0';
+    return TRUE;
+}
+
+BOOL json_read_size(json_reader *reader, size_t *value) {
+    if (json_next(reader) != JSON_NUMBER) {
+        json_skip_value(reader);
+        return FALSE;
+    }
+
+    // the input is not terminated, so the number is copied before it is converted
+    char buffer[MAX_NUMBER_SIZE];
+    size_t length = min(reader->value_size, (size_t) MAX_NUMBER_SIZE - 1);
+    memcpy(buffer, reader->value, length);
+    buffer[length] = '\0';
+    *value = (size_t) strtod(buffer, NULL);
+    return TRUE;
+}
@@ -0,0 +1,53 @@
+#ifndef __JSON_READER_H__
+#define __JSON_READER_H__
+
+#include "sys.h"
+
+// a pull parser over a json document in memory, for responses where only a few fields are needed.
+// nothing is allocated: strings are slices of the input, only unescaped when copied out,
+// and the values that are not needed are skipped without being parsed
+
+#define JSON_ERROR        -1
+#define JSON_END           0
+#define JSON_OBJECT_BEGIN  1
+#define JSON_OBJECT_END    2
+#define JSON_ARRAY_BEGIN   3
+#define JSON_ARRAY_END     4
+#define JSON_STRING        5
+#define JSON_NUMBER        6
+#define JSON_LITERAL       7
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t pos;
+
+    // the current token, value is the text of a string without its quotes, or the text of a number or literal
+    int type;
+    const char *value;
+    size_t value_size;
+} json_reader;
+
+void json_reader_init(json_reader *reader, const char *data, size_t size);
+
+// reads the next token, commas and colons are skipped
+int json_next(json_reader *reader);
+
+// skips the rest of the value that starts with the current token
+BOOL json_skip_value(json_reader *reader);
+
+// to be called after an object begin: reads the next key and returns TRUE with the reader before its value,
+// or returns FALSE at the end of the object
+BOOL json_next_member(json_reader *reader);
+
+// skips the value of the current member
+BOOL json_skip_member(json_reader *reader);
+
+// read the value of the current member, if it is not a string (or a number) it is skipped and FALSE is returned
+BOOL json_read_string(json_reader *reader, char *dest, size_t size);
+BOOL json_read_size(json_reader *reader, size_t *value);
+
+// compares the current string token, as it is written in the input
+BOOL json_string_equals(const json_reader *reader, const char *str);
+
+#endif
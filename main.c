@@ -1,84 +1,70 @@
 #include <stdio.h>
-#include <assert.h>
 
-#include <cjson/cJSON.h>
-#include <zip.h>
-
-#include "sys_windows.h"
+#include "updater.h"
+#include "download.h"
+#include "trace.h"
 #include "resources.h"
 
-#ifndef BANG_SDL_REPO_NAME
-#error "Must specify BANG_SDL_REPO_NAME"
-#else
-#define GITHUB_RELEASE_ENDPOINT "https://api.github.com/repos/" BANG_SDL_REPO_NAME "/releases/latest"
-#define GITHUB_COMMIT_ENDPOINT "https://api.github.com/repos/" BANG_SDL_REPO_NAME "/git/trees/%s"
-#endif
-
 #define WM_INSTALL_FINISHED WM_USER + 1
 #define WM_INSTALL_FAILED   WM_USER + 2
 
+#define PROGRESS_TIMER_ID 1
+#define PROGRESS_TIMER_INTERVAL 33
+
+#define MEGABYTE (1024.0 * 1024.0)
+
 const char ClassName[] = "MainWindowClass";
 
 HWND hWndMain;
 HWND hWndProgressBar;
+HWND hWndCardsProgressBar;
 HWND hWndStatus;
 
 HANDLE hDownload;
 
-const char *bang_base_dir;
+// signaled once the staging thread must stop checking for releases
+HANDLE hStopStaging;
 
-struct {
+// with --repair the installed files are verified and the damaged ones downloaded again, even when up to date
+BOOL repair_mode = FALSE;
 
-    char version[STRING_SIZE];
+CRITICAL_SECTION status_lock;
+char status_text[256];
 
-    char commit[STRING_SIZE];
-    char zip_url[STRING_SIZE];
-    size_t zip_size;
+// what the ui showed at the previous tick, throughput is measured between ticks
+typedef struct {
+    unsigned int phase[NUM_PROGRESS_CHANNELS];
+    unsigned long long bytes_done[NUM_PROGRESS_CHANNELS];
+    double time;
+    double rate;
+    char status[256];
+} progress_sample;
 
-    char cards_commit[STRING_SIZE];
-    char cards_pak_url[STRING_SIZE];
-    size_t cards_pak_size;
-
-} bang_zip_information;
+progress_sample last_sample;
 
 typedef long (__stdcall *entrypoint_fun_t)(const char*);
-typedef const char * (__stdcall *client_version_fun_t)(void);
 
 HINSTANCE load_bangclient_dll() {
     if (!file_exists(bang_base_dir)) {
         return FALSE;
     }
     SetDllDirectory(bang_base_dir);
-    return LoadLibrary("libbangclient.dll");
-}
-
-BOOL must_download_cards_pak() {
-    BOOL ret = TRUE;
-    if (bang_zip_information.cards_pak_size == 0) {
-        ret = FALSE;
-    } else {
-        HINSTANCE lib = load_bangclient_dll();
-        if (lib != NULL) {
-            client_version_fun_t fun = (client_version_fun_t) GetProcAddress(lib, "get_cards_commit_hash");
-            if (fun) {
-                const char *version = (*fun)();
-                if (strcmp(bang_zip_information.cards_commit, version) == 0) {
-                    ret = FALSE;
-                }
-            }
-            FreeLibrary(lib);
-        }
-    }
-    return ret;
+    return LoadLibrary(CLIENT_LIBRARY_NAME);
 }
 
 int launch_client() {
     int ret = 1;
+    double start = trace_begin();
     HINSTANCE lib = load_bangclient_dll();
     if (lib != NULL) {
         entrypoint_fun_t fun = (entrypoint_fun_t) GetProcAddress(lib, "entrypoint");
+        trace_end("launch", "load client", start, -1);
         if (fun) {
+            // the trace is written before the client takes over, the rest is added when it returns
+            trace_write();
+            start = trace_begin();
             (*fun)(bang_base_dir);
+            trace_end("launch", "client entrypoint", start, -1);
             ret = 0;
         }
         FreeLibrary(lib);
@@ -86,277 +72,106 @@ int launch_client() {
     return ret;
 }
 
-void get_bang_version(cJSON *latest) {
-    assert(cJSON_IsObject(latest));
-
-    cJSON *assets = cJSON_GetObjectItemCaseSensitive(latest, "assets");
-    assert(assets && cJSON_IsArray(assets) && cJSON_GetArraySize(assets) > 0);
-
-    cJSON *json_version = cJSON_GetObjectItemCaseSensitive(latest, "name");
-    assert(json_version && cJSON_IsString(json_version));
-
-    cJSON *json_commit = cJSON_GetObjectItemCaseSensitive(latest, "target_commitish");
-    assert(json_commit && cJSON_IsString(json_version));
-
-    cJSON *asset = cJSON_GetArrayItem(assets, 0);
-    assert(asset && cJSON_IsObject(asset));
-
-    cJSON *json_zip_url = cJSON_GetObjectItemCaseSensitive(asset, "browser_download_url");
-    assert(json_zip_url && cJSON_IsString(json_zip_url));
-    
-    strncpy(bang_zip_information.version, cJSON_GetStringValue(json_version), STRING_SIZE);
-    strncpy(bang_zip_information.zip_url, cJSON_GetStringValue(json_zip_url), STRING_SIZE);
-    strncpy(bang_zip_information.commit, cJSON_GetStringValue(json_commit), STRING_SIZE);
-
-    cJSON *json_zip_size = cJSON_GetObjectItemCaseSensitive(asset, "size");
-    assert(json_zip_size && cJSON_IsNumber(json_zip_size));
-
-    bang_zip_information.zip_size = (int) cJSON_GetNumberValue(json_zip_size);
-
-    if (cJSON_GetArraySize(assets) > 1) {
-        cJSON *cards_asset = cJSON_GetArrayItem(assets, 1);
-        assert(cards_asset && cJSON_IsObject(cards_asset));
-        
-        cJSON *json_cards_pak_url = cJSON_GetObjectItemCaseSensitive(cards_asset, "browser_download_url");
-        assert(json_cards_pak_url && cJSON_IsString(json_zip_url));
-
-        strncpy(bang_zip_information.cards_pak_url, cJSON_GetStringValue(json_cards_pak_url), STRING_SIZE);
-
-        cJSON *cards_json_zip_size = cJSON_GetObjectItemCaseSensitive(cards_asset, "size");
-        assert(cards_json_zip_size && cJSON_IsNumber(cards_json_zip_size));
-
-        bang_zip_information.cards_pak_size = (int) cJSON_GetNumberValue(cards_json_zip_size);
-    }
+// called from the worker threads, the text is only stored here and shown by the next timer tick
+void show_status(const char *message) {
+    EnterCriticalSection(&status_lock);
+    strncpy(status_text, message, sizeof(status_text) - 1);
+    LeaveCriticalSection(&status_lock);
 }
 
-cJSON *find_item_in_tree(cJSON *json, const char *path) {
-    assert(cJSON_IsObject(json));
-
-    cJSON *json_tree = cJSON_GetObjectItemCaseSensitive(json, "tree");
-    assert(json_tree && cJSON_IsArray(json_tree));
-
-    int json_tree_size = cJSON_GetArraySize(json_tree);
-    for (int i=0; i<json_tree_size; ++i) {
-        cJSON *json_tree_item = cJSON_GetArrayItem(json_tree, i);
-        assert(json_tree_item && cJSON_IsObject(json_tree_item));
-
-        cJSON *json_path = cJSON_GetObjectItemCaseSensitive(json_tree_item, "path");
-        assert(json_path && cJSON_IsString(json_path));
-
-        if (strcmp(cJSON_GetStringValue(json_path), path) == 0) {
-            return json_tree_item;
+// runs on the ui thread at every timer tick
+void update_progress() {
+    HWND progress_bars[NUM_PROGRESS_CHANNELS] = { hWndProgressBar, hWndCardsProgressBar };
+
+    double now = get_time_seconds();
+    unsigned long long bytes_delta = 0;
+    unsigned long long bytes_remaining = 0;
+    for (int i=0; i<NUM_PROGRESS_CHANNELS; ++i) {
+        progress_counter *counter = &updater_progress[i];
+        unsigned int phase = atomic_load(&counter->phase);
+        unsigned long long bytes_done = atomic_load(&counter->bytes_done);
+        unsigned long long bytes_total = atomic_load(&counter->bytes_total);
+
+        if (phase == last_sample.phase[i] && bytes_done >= last_sample.bytes_done[i]) {
+            bytes_delta += bytes_done - last_sample.bytes_done[i];
         }
-    }
-    return NULL;
-}
+        last_sample.phase[i] = phase;
+        last_sample.bytes_done[i] = bytes_done;
 
-int get_cards_latest_version() {
-    memory mem;
-    int errcode;
-    char buffer[STRING_SIZE];
-
-    snprintf(buffer, STRING_SIZE, GITHUB_COMMIT_ENDPOINT, bang_zip_information.commit);
-    errcode = download_file(&mem, buffer, download_query_size, NULL, NULL);
-    if (errcode == error_ok) {
-        cJSON *json = cJSON_ParseWithLength(mem.data, mem.size);
-        free(mem.data);
-
-        if (json) {
-            cJSON *json_resources = find_item_in_tree(json, "resources");
-            if (json_resources) {
-                cJSON *json_url = cJSON_GetObjectItemCaseSensitive(json_resources, "url");
-                assert(json_url && cJSON_IsString(json_url));
-
-                strncpy(buffer, cJSON_GetStringValue(json_url), STRING_SIZE);
-                cJSON_Delete(json);
-
-                errcode = download_file(&mem, buffer, download_query_size, NULL, NULL);
-                if (errcode == error_ok) {
-                    json = cJSON_ParseWithLength(mem.data, mem.size);
-                    free(mem.data);
-
-                    cJSON *json_cards = find_item_in_tree(json, "cards");
-                    if (json_cards) {
-                        cJSON *json_cards_sha = cJSON_GetObjectItemCaseSensitive(json_cards, "sha");
-                        assert(json_cards_sha && cJSON_IsString(json_cards_sha));
-
-                        strncpy(bang_zip_information.cards_commit, cJSON_GetStringValue(json_cards_sha), STRING_SIZE);
-                    } else {
-                        errcode = error_no_release_found;
-                    }
-                    cJSON_Delete(json);
-                }
-            } else {
-                errcode = error_no_release_found;
-                cJSON_Delete(json);
+        if (bytes_total != 0) {
+            SendMessage(progress_bars[i], PBM_SETPOS, (WPARAM) ((double) bytes_done / bytes_total * 0xffff), 0);
+            if (bytes_done < bytes_total) {
+                bytes_remaining += bytes_total - bytes_done;
             }
-        } else {
-            errcode = error_cant_parse_json;
-        }
-    }
-
-    return errcode;
-}
-
-int get_bang_latest_version() {
-    memory mem;
-    
-    int errcode = download_file(&mem, GITHUB_RELEASE_ENDPOINT, download_query_size, NULL, NULL);
-    if (errcode == error_ok) {
-        cJSON *json = cJSON_ParseWithLength(mem.data, mem.size);
-        free(mem.data);
-
-        if (json) {
-            get_bang_version(json);
-            cJSON_Delete(json);
-        } else {
-            errcode = error_cant_parse_json;
         }
-
-        errcode = get_cards_latest_version();
     }
 
-    return errcode;
-}
-
-int must_download_latest_version(int *result) {
-    int errcode = get_bang_latest_version();
-    *result = TRUE;
-    HINSTANCE lib = load_bangclient_dll();
-    if (lib != NULL) {
-        client_version_fun_t fun = (client_version_fun_t) GetProcAddress(lib, "get_client_commit_hash");
-        if (fun) {
-            const char *version = (*fun)();
-            if (errcode == error_cant_access_site) {
-                printf("Starting latest installed version\n");
-                errcode = error_ok;
-                *result = FALSE;
-            } else if (errcode == error_ok && strcmp(bang_zip_information.commit, version) == 0) {
-                *result = FALSE;
-            }
-        }
-        FreeLibrary(lib);
+    // smoothed over roughly the last second
+    if (last_sample.time != 0 && now > last_sample.time) {
+        last_sample.rate = last_sample.rate * 0.95 + bytes_delta / (now - last_sample.time) * 0.05;
     }
-    return errcode;
-}
-
-void set_status(const char *format, ...) {
-    static char last_buffer[256] = {0};
+    last_sample.time = now;
 
-    va_list arg;
     char buffer[256];
+    EnterCriticalSection(&status_lock);
+    strncpy(buffer, status_text, sizeof(buffer));
+    LeaveCriticalSection(&status_lock);
+
+    if (bytes_remaining != 0 && last_sample.rate >= 1024) {
+        size_t length = strlen(buffer);
+        snprintf(buffer + length, sizeof(buffer) - length, " - %.1f MB/s, %d s left",
+            last_sample.rate / MEGABYTE, (int) (bytes_remaining / last_sample.rate));
+    }
 
-    va_start(arg, format);
-    vsnprintf(buffer, 256, format, arg);
-    va_end(arg);
-
-    if (strcmp(last_buffer, buffer)) {
+    if (strcmp(last_sample.status, buffer)) {
         SendMessage(hWndStatus, SB_SETTEXT, MAKEWPARAM(0, 0), (LPARAM) buffer);
-        strncpy(last_buffer, buffer, 256);
+        strncpy(last_sample.status, buffer, sizeof(last_sample.status));
     }
 }
 
-void print_download_status(int bytes_read, int bytes_total, void *params) {
-    SendMessage(hWndProgressBar, PBM_SETPOS, (float) bytes_read / bytes_total * 0xffff, 0);
-
-    int percent = ((float) bytes_read / bytes_total * 100);
-    set_status("Download: %s ... %d %%", params, percent);
+// posted rather than sent, the window may be waiting for this thread in stop_install_thread
+DWORD install_thread(void *param) {
+    int errcode = repair_mode ? verify_installation(TRUE) : install_latest_version();
+    PostMessage(hWndMain, errcode == error_ok ? WM_INSTALL_FINISHED : WM_INSTALL_FAILED, 0, 0);
+    return 0;
 }
 
-int unzip_bang_zip(memory *mem) {
-    int result = 0;
-    zip_error_t error;
-    zip_source_t *source = zip_source_buffer_create(mem->data, mem->size, 1, &error);
-    zip_t *archive = zip_open_from_source(source, 0, &error);
-
-    if (!file_exists(bang_base_dir)) {
-        make_dir(bang_base_dir);
-    }
-
-    zip_int64_t num_entries = zip_get_num_entries(archive, 0);
-    for (zip_int64_t i=0; i<num_entries; ++i) {
-        const char *path_basename = strchr(zip_get_name(archive, i, 0), '/') + 1;
-        if (path_basename) {
-            const char *path = concat_path(bang_base_dir, path_basename);
-
-            zip_stat_t stat;
-            if (zip_stat_index(archive, i, ZIP_STAT_SIZE, &stat) != 0) continue;
-
-            zip_int64_t zip_file_size = stat.size;
-
-            if (is_directory(path)) continue;
+// runs while the game is playing: it keeps to idle cpu and disk time and the bandwidth of stage_rate_limit,
+// and checks again every STAGE_CHECK_INTERVAL seconds so that a release published during the session is staged too
+DWORD stage_thread(void *param) {
+    set_thread_background();
+    do {
+        stage_latest_version();
+    } while (WaitForSingleObject(hStopStaging, STAGE_CHECK_INTERVAL * 1000) == WAIT_TIMEOUT);
+    return 0;
+}
 
-            FILE *file_out = fopen(path, "wb");
-            if (!file_out) {
-                result = 1;
-                break;
-            }
+// the staging thread is stopped before the process exits, updater_cleanup closes the http session it uses.
+// with cancel it stops at its next download chunk or extracted file, otherwise it finishes without the rate limit
+void stop_stage_thread(BOOL cancel) {
+    if (!hDownload) return;
 
-            zip_file_t *file_in = zip_fopen_index(archive, i, 0);
-            if (file_in) {
-                set_status("Install: %s", path);
-                char buffer[BUFFER_SIZE];
-                
-                while (zip_file_size != 0) {
-                    zip_int64_t nbytes = zip_fread(file_in, buffer, BUFFER_SIZE);
-                    fwrite(buffer, nbytes, 1, file_out);
-                    zip_file_size -= nbytes;
-                }
-
-                zip_fclose(file_in);
-            }
-            fclose(file_out);
-        }
+    SetEvent(hStopStaging);
+    if (cancel) {
+        cancel_staging();
+    } else {
+        set_download_rate_limit(0);
     }
-
-    zip_close(archive);
-    return result;
+    WaitForSingleObject(hDownload, INFINITE);
+    CloseHandle(hDownload);
+    hDownload = NULL;
 }
 
-DWORD download_bang_latest_version(void *param) {
-    set_status("Download: %s...", bang_zip_information.version);
-    
-    int result = WM_INSTALL_FINISHED;
-
-    memory mem;
+// the install thread joins the cards, segment, probe and unzip threads it started before it returns, so it is
+// cancelled and waited for rather than killed: none of them is left writing to a mapped file or holding a lock
+// when updater_cleanup closes the http session
+void stop_install_thread() {
+    if (!hDownload) return;
 
-    const char *cards_pak_path = concat_path(bang_base_dir, "cards.pak");
-    if (!file_exists(cards_pak_path) || must_download_cards_pak()) {
-        if (!file_exists(bang_base_dir)) {
-            make_dir(bang_base_dir);
-        }
-        
-        download_file(&mem, bang_zip_information.cards_pak_url, bang_zip_information.cards_pak_size, print_download_status, "cards.pak");
-
-        FILE *file_out = fopen(cards_pak_path, "wb");
-        if (!file_out) {
-            result = WM_INSTALL_FAILED;
-        } else {
-            set_status("Install: cards.pak");
-
-            char *read_pos = mem.data;
-            int remaining_bytes = mem.size;
-            while (remaining_bytes != 0) {
-                int nbytes = min(BUFFER_SIZE, remaining_bytes);
-                fwrite(read_pos, nbytes, 1, file_out);
-
-                read_pos += nbytes;
-                remaining_bytes -= nbytes;
-            }
-            fclose(file_out);
-        }
-        free(mem.data);
-    }
-
-    if (result == WM_INSTALL_FINISHED) {
-        download_file(&mem, bang_zip_information.zip_url, bang_zip_information.zip_size, print_download_status, bang_zip_information.version);
-        if (unzip_bang_zip(&mem) != 0) {
-            result = WM_INSTALL_FAILED;
-        }
-    }
-
-    SendMessage(hWndMain, result, 0, 0);
-    return 0;
+    cancel_downloads();
+    WaitForSingleObject(hDownload, INFINITE);
+    CloseHandle(hDownload);
+    hDownload = NULL;
 }
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
@@ -376,6 +191,20 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
             (HINSTANCE)GetWindowLong(hWnd, GWLP_HINSTANCE),
             NULL);
 
+        hWndCardsProgressBar = CreateWindowEx(
+            0,
+            PROGRESS_CLASS,
+            (LPSTR)NULL,
+            WS_VISIBLE | WS_CHILD,
+            10,
+            35,
+            360,
+            20,
+            hWnd,
+            (HMENU)IDPB_CARDS_PROGRESS_BAR,
+            (HINSTANCE)GetWindowLong(hWnd, GWLP_HINSTANCE),
+            NULL);
+
         hWndStatus = CreateWindowEx(
             0,
             STATUSCLASSNAME,
@@ -387,17 +216,26 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
             (HINSTANCE)GetWindowLong(hWnd, GWLP_HINSTANCE),
             NULL);
 
-        hDownload = CreateThread(NULL, 0, download_bang_latest_version, NULL, 0, NULL);
-            
         SendMessage(hWndProgressBar, PBM_SETRANGE, 0, MAKELPARAM(0, 0xffff));
+        SendMessage(hWndCardsProgressBar, PBM_SETRANGE, 0, MAKELPARAM(0, 0xffff));
+
+        // progress is sampled by the ui instead of being pushed by the download threads
+        SetTimer(hWnd, PROGRESS_TIMER_ID, PROGRESS_TIMER_INTERVAL, NULL);
+
+        hDownload = CreateThread(NULL, 0, install_thread, NULL, 0, NULL);
         break;
     }
+    case WM_TIMER:
+        update_progress();
+        break;
     case WM_INSTALL_FAILED:
+        KillTimer(hWnd, PROGRESS_TIMER_ID);
         message_box("Installation failed!", MB_ICONERROR);
         DestroyWindow(hWndMain);
         PostQuitMessage(0);
         break;
     case WM_INSTALL_FINISHED:
+        KillTimer(hWnd, PROGRESS_TIMER_ID);
         DestroyWindow(hWndMain);
         launch_client();
         PostQuitMessage(0);
@@ -406,7 +244,8 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
         PostQuitMessage(0);
         break;
     case WM_CLOSE:
-        TerminateThread(hDownload, 0);
+        KillTimer(hWnd, PROGRESS_TIMER_ID);
+        stop_install_thread();
         // fall through
     default:
         return (DefWindowProc(hWnd, Msg, wParam, lParam));
@@ -452,9 +291,36 @@ INT WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         return 0;
     }
     
-    memset(&bang_zip_information, 0, sizeof(bang_zip_information));
+    InitializeCriticalSection(&status_lock);
+
+    updater_ui.status = show_status;
+    updater_init();
+    atexit(updater_cleanup);
 
-    bang_base_dir = get_bang_bin_path();
+    // --trace takes precedence over BANG_TRACE, paths with spaces can only be given through the variable
+    char trace_path[MAX_PATH];
+    const char *trace_arg = strstr(lpCmdLine, "--trace ");
+    if (trace_arg && sscanf(trace_arg, "--trace %259s", trace_path) == 1) {
+        trace_enable(trace_path);
+    }
+
+    if (apply_staged_update() != 0) {
+        printf("Could not apply staged update\n");
+    }
+
+    // in launch-first mode the installed client starts right away and the next release is staged for the next start
+    if (strstr(lpCmdLine, "--launch-first") && file_exists(concat_path(bang_base_dir, CLIENT_LIBRARY_NAME))) {
+        hStopStaging = CreateEvent(NULL, TRUE, FALSE, NULL);
+        hDownload = CreateThread(NULL, 0, stage_thread, NULL, 0, NULL);
+        if (launch_client() == 0) {
+            // the game has exited, what is not staged yet is resumed during the next session
+            stop_stage_thread(TRUE);
+            return 0;
+        }
+        // the client could not be started, the staged release is now waited for at full speed
+        stop_stage_thread(FALSE);
+        apply_staged_update();
+    }
 
     int result = FALSE;
     int errcode = must_download_latest_version(&result);
@@ -462,7 +328,8 @@ INT WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         show_error_message(errcode);
         return 0;
     }
-    if (!result) {
+    repair_mode = strstr(lpCmdLine, "--repair") != NULL;
+    if (!result && !repair_mode) {
         launch_client();
         return 0;
     }
@@ -471,7 +338,7 @@ INT WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     GetClientRect(GetDesktopWindow(), &desktop_rect);
 
     const int window_width = 400;
-    const int window_height = 100;
+    const int window_height = 125;
     const int window_left = desktop_rect.left + (desktop_rect.right - desktop_rect.left - window_width) / 2;
     const int window_top = desktop_rect.top + (desktop_rect.bottom - desktop_rect.top - window_height) / 2;
 
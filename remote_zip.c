@@ -0,0 +1,211 @@
+#include "remote_zip.h"
+#include "download.h"
+#include "trace.h"
+
+#define EOCD_SIGNATURE 0x06054b50
+#define EOCD_SIZE 22
+#define MAX_ZIP_COMMENT_SIZE 0xffff
+
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIGNATURE 0x06064b50
+#define ZIP64_EOCD_SIZE 56
+#define ZIP64_EXTRA_ID 0x0001
+
+#define CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define CENTRAL_HEADER_SIZE 46
+
+// the tail read first holds the end of central directory record, its comment and the zip64 records before it,
+// and for most archives the whole central directory
+#define ZIP_TAIL_SIZE (EOCD_SIZE + MAX_ZIP_COMMENT_SIZE + ZIP64_LOCATOR_SIZE + ZIP64_EOCD_SIZE)
+
+typedef struct {
+    size_t offset;
+    BOOL needed;
+} zip_entry_location;
+
+typedef struct {
+    size_t bytes_skipped;
+    downloading_callback callback;
+    void *params;
+} zip_progress;
+
+static unsigned int read_u16(const unsigned char *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static unsigned int read_u32(const unsigned char *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int) data[3] << 24);
+}
+
+static unsigned long long read_u64(const unsigned char *data) {
+    return read_u32(data) | ((unsigned long long) read_u32(data + 4) << 32);
+}
+
+static int compare_zip_entry_offsets(const void *lhs, const void *rhs) {
+    size_t lhs_offset = ((const zip_entry_location *) lhs)->offset;
+    size_t rhs_offset = ((const zip_entry_location *) rhs)->offset;
+    return (lhs_offset > rhs_offset) - (lhs_offset < rhs_offset);
+}
+
+static void zip_progress_callback(int bytes_read, int bytes_total, void *params) {
+    zip_progress *progress = (zip_progress *) params;
+    if (progress->callback) {
+        progress->callback(progress->bytes_skipped + bytes_read, bytes_total, progress->params);
+    }
+}
+
+// the 32 bit fields of a central header that are saturated are stored in the zip64 extra field, in this order
+static BOOL read_zip64_extra(const unsigned char *extra, size_t extra_size, unsigned long long *size, unsigned long long *compressed_size, unsigned long long *offset) {
+    while (extra_size >= 4) {
+        unsigned int id = read_u16(extra);
+        unsigned int field_size = read_u16(extra + 2);
+        if (field_size + 4 > extra_size) return FALSE;
+
+        if (id == ZIP64_EXTRA_ID) {
+            const unsigned char *field = extra + 4;
+            unsigned long long *values[] = { size, compressed_size, offset };
+            for (int i=0; i<3; ++i) {
+                if (*values[i] != 0xffffffff) continue;
+                if (field + 8 > extra + 4 + field_size) return FALSE;
+                *values[i] = read_u64(field);
+                field += 8;
+            }
+            return TRUE;
+        }
+        extra += field_size + 4;
+        extra_size -= field_size + 4;
+    }
+    return TRUE;
+}
+
+int download_zip_entries(const char *filename, const char *url, size_t zip_size, zip_entry_filter filter, void *filter_params,
+    size_t *bytes_downloaded, downloading_callback callback, void *params)
+{
+    *bytes_downloaded = 0;
+    double start_time = get_time_seconds();
+
+    if (zip_size < EOCD_SIZE) {
+        return error_bad_archive;
+    }
+
+    mapped_file output;
+    if (!map_output_file(&output, filename, zip_size, FALSE)) {
+        unmap_output_file(&output);
+        return error_cant_write_file;
+    }
+
+    zip_entry_location *entries = NULL;
+    byte_range *ranges = NULL;
+    const unsigned char *view = (const unsigned char *) output.view;
+
+    // the tail, the central directory and the entries all come from the endpoints ranked here
+    endpoint_list endpoints;
+    rank_endpoints(&endpoints, url, zip_size);
+
+    byte_range tail = { zip_size - min(zip_size, (size_t) ZIP_TAIL_SIZE), zip_size };
+    int errcode = download_ranges(output.view, &endpoints, zip_size, &tail, 1, NULL, NULL);
+    if (errcode != error_ok) goto finish;
+    *bytes_downloaded = tail.end - tail.begin;
+
+    errcode = error_bad_archive;
+    size_t eocd = zip_size - EOCD_SIZE;
+    while (read_u32(view + eocd) != EOCD_SIGNATURE) {
+        if (eocd == tail.begin) goto finish;
+        --eocd;
+    }
+
+    unsigned long long num_entries = read_u16(view + eocd + 10);
+    unsigned long long cd_size = read_u32(view + eocd + 12);
+    unsigned long long cd_offset = read_u32(view + eocd + 16);
+    if (num_entries == 0xffff || cd_size == 0xffffffff || cd_offset == 0xffffffff) {
+        if (eocd < tail.begin + ZIP64_LOCATOR_SIZE || read_u32(view + eocd - ZIP64_LOCATOR_SIZE) != ZIP64_LOCATOR_SIGNATURE) goto finish;
+
+        unsigned long long zip64_eocd = read_u64(view + eocd - ZIP64_LOCATOR_SIZE + 8);
+        if (zip64_eocd < tail.begin || zip64_eocd + ZIP64_EOCD_SIZE > zip_size || read_u32(view + zip64_eocd) != ZIP64_EOCD_SIGNATURE) goto finish;
+
+        num_entries = read_u64(view + zip64_eocd + 32);
+        cd_size = read_u64(view + zip64_eocd + 40);
+        cd_offset = read_u64(view + zip64_eocd + 48);
+    }
+    if (cd_offset + cd_size > zip_size || num_entries > cd_size / CENTRAL_HEADER_SIZE) goto finish;
+
+    if (cd_offset < tail.begin) {
+        byte_range cd_range = { cd_offset, tail.begin };
+        errcode = download_ranges(output.view, &endpoints, zip_size, &cd_range, 1, NULL, NULL);
+        if (errcode != error_ok) goto finish;
+        *bytes_downloaded += cd_range.end - cd_range.begin;
+        errcode = error_bad_archive;
+    }
+
+    entries = (zip_entry_location *) malloc((num_entries + 1) * sizeof(zip_entry_location));
+    ranges = (byte_range *) malloc((num_entries + 1) * sizeof(byte_range));
+    if (!entries || !ranges) goto finish;
+
+    const unsigned char *header = view + cd_offset;
+    const unsigned char *cd_end = view + cd_offset + cd_size;
+    for (unsigned long long i=0; i<num_entries; ++i) {
+        if (header + CENTRAL_HEADER_SIZE > cd_end || read_u32(header) != CENTRAL_HEADER_SIGNATURE) goto finish;
+
+        unsigned int crc = read_u32(header + 16);
+        unsigned long long compressed_size = read_u32(header + 20);
+        unsigned long long size = read_u32(header + 24);
+        size_t name_size = read_u16(header + 28);
+        size_t extra_size = read_u16(header + 30);
+        size_t comment_size = read_u16(header + 32);
+        unsigned long long offset = read_u32(header + 42);
+        if (header + CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size > cd_end) goto finish;
+
+        const unsigned char *extra = header + CENTRAL_HEADER_SIZE + name_size;
+        if (!read_zip64_extra(extra, extra_size, &size, &compressed_size, &offset) || offset >= cd_offset) goto finish;
+
+        char name[MAX_PATH];
+        size_t length = min(name_size, (size_t) MAX_PATH - 1);
+        memcpy(name, header + CENTRAL_HEADER_SIZE, length);
+        name[length] = '\0';
+
+        entries[i].offset = offset;
+        entries[i].needed = filter(name, size, crc, filter_params);
+        header += CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size;
+    }
+
+    // an entry spans from its local header to the next one, which covers its data descriptor if it has one
+    qsort(entries, num_entries, sizeof(zip_entry_location), compare_zip_entry_offsets);
+    int num_ranges = 0;
+    size_t range_bytes = 0;
+    for (unsigned long long i=0; i<num_entries; ++i) {
+        if (!entries[i].needed) continue;
+
+        size_t begin = entries[i].offset;
+        size_t end = i + 1 < num_entries ? entries[i + 1].offset : cd_offset;
+        if (num_ranges != 0 && begin - ranges[num_ranges - 1].end <= MAX_ZIP_RANGE_GAP) {
+            range_bytes += end - ranges[num_ranges - 1].end;
+            ranges[num_ranges - 1].end = end;
+        } else if (end > begin) {
+            ranges[num_ranges].begin = begin;
+            ranges[num_ranges].end = end;
+            range_bytes += end - begin;
+            ++num_ranges;
+        }
+    }
+    trace_end("remote zip", "read central directory", start_time, *bytes_downloaded);
+
+    zip_progress progress = { zip_size - range_bytes, callback, params };
+    zip_progress_callback(0, zip_size, &progress);
+
+    errcode = download_ranges(output.view, &endpoints, zip_size, ranges, num_ranges, zip_progress_callback, &progress);
+    if (errcode == error_ok) {
+        *bytes_downloaded += range_bytes;
+    }
+
+finish:
+    unmap_output_file(&output);
+    if (errcode != error_ok) {
+        remove_file(filename);
+    }
+    free(entries);
+    free(ranges);
+
+    trace_end("remote zip", "download_zip_entries", start_time, *bytes_downloaded);
+    return errcode;
+}
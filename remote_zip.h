@@ -0,0 +1,19 @@
+#ifndef __REMOTE_ZIP_H__
+#define __REMOTE_ZIP_H__
+
+#include "sys.h"
+
+// ranges of needed entries closer than this are downloaded with a single request
+#define MAX_ZIP_RANGE_GAP (64 * 1024)
+
+// returns TRUE if the entry must be downloaded, size is its uncompressed size
+typedef BOOL (*zip_entry_filter) (const char *name, size_t size, unsigned int crc, void *params);
+
+// downloads part of a remote zip into filename, at the same offsets as in the archive: its central directory
+// and the entries accepted by filter. the rest of the file is left empty, so libzip can open the copy and read
+// the downloaded entries. the zip digest does not apply to the copy, the extraction checks the crc of each entry.
+// returns error_bad_archive if the file is not a zip, bytes_downloaded is set to the number of bytes transferred
+int download_zip_entries(const char *filename, const char *url, size_t zip_size, zip_entry_filter filter, void *filter_params,
+    size_t *bytes_downloaded, downloading_callback callback, void *params);
+
+#endif
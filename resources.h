@@ -1,3 +1,4 @@
 #define IDI_ICON            1000
 #define IDPB_PROGRESS_BAR   1001
-#define IDPB_STATUS_BAR     1002
\ No newline at end of file
+#define IDPB_STATUS_BAR     1002
+#define IDPB_CARDS_PROGRESS_BAR 1003
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef __SYS_H__
+#define __SYS_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+typedef struct _memory {
+    char *data;
+    size_t size;
+    size_t capacity;
+} memory;
+
+#define BUFFER_SIZE 1024
+#define STRING_SIZE 256
+#define SHA256_HEX_SIZE 65
+
+#define MIN_READ_SIZE (16 * 1024)
+#define MAX_READ_SIZE (256 * 1024)
+#define FILE_SINK_BUFFER_SIZE MAX_READ_SIZE
+
+#define error_ok                0
+#define error_cant_init_inet    1
+#define error_cant_access_site  2
+#define error_cant_parse_json   3
+#define error_no_release_found  4
+#define error_cant_write_file   5
+#define error_range_ignored     6
+#define error_not_modified      7
+#define error_checksum_mismatch 8
+#define error_bad_archive       9
+#define error_too_slow         10
+#define error_cancelled        11
+
+#define download_query_size ((size_t) -1)
+
+typedef void (*downloading_callback) (int bytes_read, int bytes_total, void *params);
+
+// a sink is where downloaded bytes go. reserve returns a writable region of at most *size bytes
+// (and updates *size with its actual length), the data is read directly into it and then passed to commit
+typedef struct _byte_sink {
+    char *(*reserve)(struct _byte_sink *sink, size_t *size);
+    int (*commit)(struct _byte_sink *sink, const char *data, size_t nbytes);
+} byte_sink;
+
+typedef struct {
+    size_t begin;
+    size_t end;
+} byte_range;
+
+typedef struct {
+    char user_agent[STRING_SIZE];
+    char proxy[STRING_SIZE];
+    int timeout_ms;
+} http_session_config;
+
+// filled in by download_file_impl, times are in seconds from the start of the request and negative if unknown
+typedef struct {
+    double dns_time;
+    double connect_time;
+    double first_byte_time;
+    double total_time;
+    size_t bytes_read;
+} http_timing;
+
+typedef int (*thread_function) (void *param);
+
+// each platform layer provides the same set of functions:
+// threads (thread_create, thread_join, get_thread_id), sleep_ms, get_num_cpus, get_time_seconds, get_peak_memory_usage,
+// file helpers, mapped output files, sha256_context, http_session and download_file_impl, and probe_client_version
+#ifdef _WIN32
+#include "sys_windows.h"
+#else
+#include "sys_posix.h"
+#endif
+
+#endif
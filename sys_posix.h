@@ -0,0 +1,607 @@
+#ifndef __SYS_POSIX_H__
+#define __SYS_POSIX_H__
+
+#include <stdint.h>
+#include <strings.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <curl/curl.h>
+
+typedef int BOOL;
+#define TRUE 1
+#define FALSE 0
+
+#define MAX_PATH PATH_MAX
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define _stricmp strcasecmp
+
+#define CLIENT_LIBRARY_NAME "libbangclient.so"
+
+typedef struct {
+    pthread_t thread;
+    thread_function fun;
+    void *param;
+    int result;
+} thread_t;
+
+static void *thread_start(void *param) {
+    thread_t *thread = (thread_t *) param;
+    thread->result = thread->fun(thread->param);
+    return NULL;
+}
+
+// thread must stay valid until it is joined
+static BOOL thread_create(thread_t *thread, thread_function fun, void *param) {
+    thread->fun = fun;
+    thread->param = param;
+    thread->result = 1;
+    return pthread_create(&thread->thread, NULL, thread_start, thread) == 0;
+}
+
+static int thread_join(thread_t *thread) {
+    pthread_join(thread->thread, NULL);
+    return thread->result;
+}
+
+static unsigned long long get_thread_id() {
+    return (unsigned long long) pthread_self();
+}
+
+// for work that runs while the game is playing, the thread gets whatever cpu and disk time is left
+static void set_thread_background() {
+#ifdef __APPLE__
+    // also lowers the priority of the disk and network accesses of the thread
+    setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+#elif defined(__linux__)
+    // the nice value is per thread on linux, and threads created afterwards inherit it
+    setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), 19);
+#endif
+}
+
+static void sleep_ms(int ms) {
+    usleep(ms * 1000);
+}
+
+static int get_num_cpus() {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cpus > 0 ? (int) num_cpus : 1;
+}
+
+// monotonic clock, only meaningful for measuring durations
+static double get_time_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t get_peak_memory_usage() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t) usage.ru_maxrss;
+#else
+    // linux reports kilobytes
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+}
+
+// portable SHA-256, there is no system provider to rely on here
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t block_size;
+} sha256_context;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_transform(sha256_context *ctx, const unsigned char *block) {
+    uint32_t w[64];
+    for (int i=0; i<16; ++i) {
+        w[i] = (uint32_t) block[i * 4] << 24 | (uint32_t) block[i * 4 + 1] << 16 | (uint32_t) block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i=16; i<64; ++i) {
+        uint32_t s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+    for (int i=0; i<64; ++i) {
+        uint32_t t1 = h + (SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^ SHA256_ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^ SHA256_ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+    ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+static BOOL sha256_init(sha256_context *ctx) {
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memset(ctx, 0, sizeof(sha256_context));
+    memcpy(ctx->state, initial_state, sizeof(initial_state));
+    return TRUE;
+}
+
+static void sha256_update(sha256_context *ctx, const char *data, size_t nbytes) {
+    ctx->length += nbytes;
+    while (nbytes != 0) {
+        if (ctx->block_size == 0 && nbytes >= 64) {
+            sha256_transform(ctx, (const unsigned char *) data);
+            data += 64;
+            nbytes -= 64;
+            continue;
+        }
+        size_t chunk_size = min(nbytes, 64 - ctx->block_size);
+        memcpy(ctx->block + ctx->block_size, data, chunk_size);
+        ctx->block_size += chunk_size;
+        data += chunk_size;
+        nbytes -= chunk_size;
+        if (ctx->block_size == 64) {
+            sha256_transform(ctx, ctx->block);
+            ctx->block_size = 0;
+        }
+    }
+}
+
+static void sha256_final_hex(sha256_context *ctx, char *hex) {
+    uint64_t bit_length = ctx->length * 8;
+
+    ctx->block[ctx->block_size++] = 0x80;
+    if (ctx->block_size > 56) {
+        memset(ctx->block + ctx->block_size, 0, 64 - ctx->block_size);
+        sha256_transform(ctx, ctx->block);
+        ctx->block_size = 0;
+    }
+    memset(ctx->block + ctx->block_size, 0, 56 - ctx->block_size);
+    for (int i=0; i<8; ++i) {
+        ctx->block[56 + i] = (unsigned char) (bit_length >> (56 - i * 8));
+    }
+    sha256_transform(ctx, ctx->block);
+
+    for (int i=0; i<8; ++i) {
+        snprintf(hex + i * 8, 9, "%08x", ctx->state[i]);
+    }
+}
+
+static void sha256_free(sha256_context *ctx) {
+    memset(ctx, 0, sizeof(sha256_context));
+}
+
+// a single share handle is used by every request, so that connections, dns entries and tls sessions are reused
+typedef struct {
+    CURLSH *share;
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+    http_session_config config;
+} http_session;
+
+static void http_session_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    pthread_mutex_lock(&((http_session *) userptr)->locks[data]);
+}
+
+static void http_session_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    pthread_mutex_unlock(&((http_session *) userptr)->locks[data]);
+}
+
+static int http_session_open(http_session *session, const http_session_config *config) {
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        return error_cant_init_inet;
+    }
+    session->config = *config;
+    session->share = curl_share_init();
+    if (!session->share) {
+        return error_cant_init_inet;
+    }
+
+    for (int i=0; i<CURL_LOCK_DATA_LAST; ++i) {
+        pthread_mutex_init(&session->locks[i], NULL);
+    }
+    curl_share_setopt(session->share, CURLSHOPT_LOCKFUNC, http_session_lock);
+    curl_share_setopt(session->share, CURLSHOPT_UNLOCKFUNC, http_session_unlock);
+    curl_share_setopt(session->share, CURLSHOPT_USERDATA, session);
+    curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return error_ok;
+}
+
+static void http_session_close(http_session *session) {
+    if (session->share) {
+        curl_share_cleanup(session->share);
+        session->share = NULL;
+        for (int i=0; i<CURL_LOCK_DATA_LAST; ++i) {
+            pthread_mutex_destroy(&session->locks[i]);
+        }
+    }
+}
+
+typedef struct {
+    CURL *curl;
+    byte_sink *sink;
+    const byte_range *range;
+    const char *if_none_match;
+    char *etag;
+    BOOL status_checked;
+    int errcode;
+    size_t download_size;
+    size_t total_bytes_read;
+    downloading_callback callback;
+    void *params;
+} http_transfer;
+
+static int check_http_status(http_transfer *transfer) {
+    long status = 0;
+    curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &status);
+    transfer->status_checked = TRUE;
+    if (transfer->range && status == 200) {
+        return error_range_ignored;
+    } else if (transfer->if_none_match && status == 304) {
+        return error_not_modified;
+    } else if (status != (transfer->range ? 206 : 200)) {
+        return error_cant_access_site;
+    }
+    return error_ok;
+}
+
+static size_t http_header_data(char *data, size_t size, size_t nitems, void *userdata) {
+    http_transfer *transfer = (http_transfer *) userdata;
+    size_t nbytes = size * nitems;
+    if (!transfer->etag) {
+        return nbytes;
+    }
+
+    if (nbytes >= 5 && strncmp(data, "HTTP/", 5) == 0) {
+        // every response after a redirect starts with its own status line
+        *transfer->etag = '\0';
+    } else if (nbytes > 5 && strncasecmp(data, "ETag:", 5) == 0) {
+        const char *begin = data + 5;
+        const char *end = data + nbytes;
+        while (begin != end && (*begin == ' ' || *begin == '\t')) ++begin;
+        while (end != begin && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) --end;
+
+        size_t length = min((size_t) (end - begin), (size_t) STRING_SIZE - 1);
+        memcpy(transfer->etag, begin, length);
+        transfer->etag[length] = '\0';
+    }
+    return nbytes;
+}
+
+// curl chooses the chunk size, each chunk is copied into the regions reserved from the sink
+static size_t http_write_data(char *data, size_t size, size_t nmemb, void *userdata) {
+    http_transfer *transfer = (http_transfer *) userdata;
+    size_t nbytes = size * nmemb;
+
+    if (!transfer->status_checked && (transfer->errcode = check_http_status(transfer)) != error_ok) {
+        return 0;
+    }
+
+    size_t remaining_bytes = nbytes;
+    while (remaining_bytes != 0) {
+        size_t reserved_size = remaining_bytes;
+        char *dest = transfer->sink->reserve(transfer->sink, &reserved_size);
+        if (!dest || reserved_size == 0) {
+            transfer->errcode = error_cant_write_file;
+            return 0;
+        }
+        reserved_size = min(reserved_size, remaining_bytes);
+        memcpy(dest, data, reserved_size);
+        if ((transfer->errcode = transfer->sink->commit(transfer->sink, dest, reserved_size)) != error_ok) {
+            return 0;
+        }
+        data += reserved_size;
+        remaining_bytes -= reserved_size;
+    }
+    transfer->total_bytes_read += nbytes;
+
+    if (transfer->callback) {
+        transfer->callback(transfer->total_bytes_read, transfer->download_size, transfer->params);
+    }
+    return nbytes;
+}
+
+// the response is passed to sink as it arrives.
+// if range is not NULL only the bytes in [begin, end) are requested, guarded by etag if it is known;
+// error_range_ignored is returned if the server answers with the whole file instead.
+// if if_none_match is not NULL the request is conditional and error_not_modified is returned on a 304 response.
+// the ETag of the response is stored back in etag
+static int download_file_impl(http_session *session, byte_sink *sink, const char *url, size_t download_size, const byte_range *range, const char *if_none_match, char *etag, downloading_callback callback, void *params, http_timing *timing) {
+    if (timing) {
+        memset(timing, 0, sizeof(http_timing));
+    }
+    if (!session->share) {
+        return error_cant_init_inet;
+    }
+
+    CURL *curl = curl_easy_init();
+    if (!curl) {
+        return error_cant_init_inet;
+    }
+
+    struct curl_slist *headers = NULL;
+    char header[STRING_SIZE * 2];
+    if (range) {
+        snprintf(header, sizeof(header), "Range: bytes=%llu-%llu",
+            (unsigned long long) range->begin, (unsigned long long) range->end - 1);
+        headers = curl_slist_append(headers, header);
+        if (etag && *etag) {
+            snprintf(header, sizeof(header), "If-Range: %s", etag);
+            headers = curl_slist_append(headers, header);
+        }
+    } else if (if_none_match && *if_none_match) {
+        snprintf(header, sizeof(header), "If-None-Match: %s", if_none_match);
+        headers = curl_slist_append(headers, header);
+    }
+
+    http_transfer transfer;
+    memset(&transfer, 0, sizeof(transfer));
+    transfer.curl = curl;
+    transfer.sink = sink;
+    transfer.range = range;
+    transfer.if_none_match = if_none_match;
+    transfer.etag = etag;
+    transfer.download_size = download_size;
+    transfer.total_bytes_read = range ? range->begin : 0;
+    transfer.callback = callback;
+    transfer.params = params;
+
+    const http_session_config *config = &session->config;
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_SHARE, session->share);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, config->user_agent);
+    if (*config->proxy) {
+        curl_easy_setopt(curl, CURLOPT_PROXY, config->proxy);
+    }
+    // the timeout applies to connecting and to stalls, not to the whole transfer
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long) config->timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long) max(config->timeout_ms / 1000, 1));
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, http_header_data);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, http_write_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+    curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long) MAX_READ_SIZE);
+
+    int errcode = error_ok;
+    CURLcode result = curl_easy_perform(curl);
+    if (transfer.errcode != error_ok) {
+        errcode = transfer.errcode;
+    } else if (result != CURLE_OK) {
+        errcode = error_cant_access_site;
+    } else if (!transfer.status_checked) {
+        // responses without a body, such as 304, never reach the write callback
+        errcode = check_http_status(&transfer);
+    } else if (download_size != download_query_size && transfer.total_bytes_read != (range ? range->end : download_size)) {
+        // the connection was closed before the expected size was reached
+        errcode = error_cant_access_site;
+    }
+
+    if (timing) {
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &timing->dns_time);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &timing->connect_time);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &timing->first_byte_time);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &timing->total_time);
+        timing->bytes_read = transfer.total_bytes_read - (range ? range->begin : 0);
+    }
+
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+    return errcode;
+}
+
+static const char *get_bang_bin_path() {
+    static char path[MAX_PATH];
+    const char *data_home = getenv("XDG_DATA_HOME");
+    if (data_home && *data_home) {
+        snprintf(path, MAX_PATH, "%s/bang-sdl/bin", data_home);
+        return path;
+    }
+    const char *home = getenv("HOME");
+    if (home && *home) {
+        snprintf(path, MAX_PATH, "%s/.local/share/bang-sdl/bin", home);
+        return path;
+    }
+    return NULL;
+}
+
+static const char *concat_path(const char *dir, const char *filename) {
+    static char path[MAX_PATH];
+    snprintf(path, MAX_PATH, "%s/%s", dir, filename);
+    return path;
+}
+
+static void make_dir(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        const char *last_slash_pos = strrchr(filename, '/');
+        if (last_slash_pos && last_slash_pos != filename) {
+            char sub_path[MAX_PATH];
+            strncpy(sub_path, filename, last_slash_pos - filename);
+            sub_path[last_slash_pos - filename] = '\0';
+
+            make_dir(sub_path);
+        }
+
+        mkdir(filename, 0755);
+    }
+}
+
+static int file_exists(const char *filename) {
+    return access(filename, F_OK) == 0;
+}
+
+static BOOL move_file(const char *from, const char *to) {
+    return rename(from, to) == 0;
+}
+
+static void remove_file(const char *filename) {
+    unlink(filename);
+}
+
+// removes a directory with everything in it
+static void remove_dir(const char *filename) {
+    DIR *dir = opendir(filename);
+    if (!dir) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char path[MAX_PATH];
+        snprintf(path, MAX_PATH, "%s/%s", filename, entry->d_name);
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            remove_dir(path);
+        } else {
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    rmdir(filename);
+}
+
+static BOOL is_directory(const char *filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// 0 if the file does not exist
+static unsigned long long get_file_size(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return 0;
+    return (unsigned long long) st.st_size;
+}
+
+// the modification time is in microseconds since the epoch, on every platform
+static BOOL get_file_info(const char *filename, unsigned long long *size, unsigned long long *mtime) {
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) return FALSE;
+
+    *size = st.st_size;
+#ifdef __APPLE__
+    *mtime = st.st_mtimespec.tv_sec * 1000000ULL + st.st_mtimespec.tv_nsec / 1000;
+#else
+    *mtime = st.st_mtim.tv_sec * 1000000ULL + st.st_mtim.tv_nsec / 1000;
+#endif
+    return TRUE;
+}
+
+// reserves the disk space of a file that is about to be written, so that it is laid out in one piece instead of
+// growing one write at a time. it is only a hint, a full disk is still reported by the writes themselves
+static void preallocate_fd(int fd, size_t size) {
+    if (size == 0) return;
+#ifdef __APPLE__
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t) size, 0 };
+    if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+        // contiguous space is not always available
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(fd, F_PREALLOCATE, &store);
+    }
+#else
+    posix_fallocate(fd, 0, size);
+#endif
+}
+
+static void preallocate_file(FILE *file, size_t size) {
+    preallocate_fd(fileno(file), size);
+}
+
+// fseek takes a long, which cannot reach past 2GB where it has 32 bits
+static BOOL seek_file(FILE *file, unsigned long long offset) {
+    return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+}
+
+// the output of a segmented download is preallocated and mapped in memory, each segment reads directly into its own slice
+typedef struct {
+    int fd;
+    char *view;
+    size_t size;
+} mapped_file;
+
+// keep_contents reopens a partially downloaded file instead of starting from an empty one
+static BOOL map_output_file(mapped_file *file, const char *filename, size_t size, BOOL keep_contents) {
+    memset(file, 0, sizeof(mapped_file));
+
+    file->fd = open(filename, O_RDWR | O_CREAT | (keep_contents ? 0 : O_TRUNC), 0644);
+    if (file->fd < 0 || ftruncate(file->fd, size) != 0) {
+        return FALSE;
+    }
+
+    void *view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (view == MAP_FAILED) {
+        return FALSE;
+    }
+    file->view = (char *) view;
+    file->size = size;
+    return TRUE;
+}
+
+// ftruncate leaves the file sparse, its blocks would otherwise be allocated in the order the segments fill them
+static void preallocate_output_file(mapped_file *file) {
+    preallocate_fd(file->fd, file->size);
+}
+
+static void unmap_output_file(mapped_file *file) {
+    if (file->view) munmap(file->view, file->size);
+    if (file->fd >= 0) close(file->fd);
+    memset(file, 0, sizeof(mapped_file));
+    file->fd = -1;
+}
+
+typedef const char * (*client_version_fun_t)(void);
+
+// only needed for installs that predate the version manifest
+static BOOL probe_client_version(const char *base_dir, char *client_commit, char *cards_commit) {
+    void *lib = dlopen(concat_path(base_dir, CLIENT_LIBRARY_NAME), RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        return FALSE;
+    }
+    client_version_fun_t fun = (client_version_fun_t) dlsym(lib, "get_client_commit_hash");
+    if (fun) {
+        strncpy(client_commit, (*fun)(), STRING_SIZE - 1);
+    }
+    fun = (client_version_fun_t) dlsym(lib, "get_cards_commit_hash");
+    if (fun) {
+        strncpy(cards_commit, (*fun)(), STRING_SIZE - 1);
+    }
+    dlclose(lib);
+    return TRUE;
+}
+
+#endif
@@ -1,54 +1,201 @@
 #ifndef __SYS_WINDOWS_H__
 #define __SYS_WINDOWS_H__
 
+#include <io.h>
 #include <Windows.h>
 #include <Shlwapi.h>
 #include <ShlObj.h>
 #include <WinInet.h>
+#include <bcrypt.h>
+#include <Psapi.h>
 
-typedef struct _memory {
-    char *data;
-    size_t size;
-    size_t capacity;
-} memory;
+#define CLIENT_LIBRARY_NAME "libbangclient.dll"
 
-#define BUFFER_SIZE 1024
-#define STRING_SIZE 256
+typedef struct {
+    HANDLE hThread;
+    thread_function fun;
+    void *param;
+} thread_t;
 
-#define error_ok                0
-#define error_cant_init_inet    1
-#define error_cant_access_site  2
-#define error_cant_parse_json   3
-#define error_no_release_found  4
+static DWORD WINAPI thread_start(void *param) {
+    thread_t *thread = (thread_t *) param;
+    return (DWORD) thread->fun(thread->param);
+}
+
+// thread must stay valid until it is joined
+static BOOL thread_create(thread_t *thread, thread_function fun, void *param) {
+    thread->fun = fun;
+    thread->param = param;
+    thread->hThread = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+    return thread->hThread != NULL;
+}
+
+static int thread_join(thread_t *thread) {
+    DWORD result = 1;
+    WaitForSingleObject(thread->hThread, INFINITE);
+    GetExitCodeThread(thread->hThread, &result);
+    CloseHandle(thread->hThread);
+    thread->hThread = NULL;
+    return (int) result;
+}
+
+static unsigned long long get_thread_id() {
+    return GetCurrentThreadId();
+}
+
+// for work that runs while the game is playing, the thread gets whatever cpu and disk time is left
+static void set_thread_background() {
+    // also lowers the priority of the disk accesses and memory of the thread
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+}
+
+static void sleep_ms(int ms) {
+    Sleep(ms);
+}
+
+static int get_num_cpus() {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (int) system_info.dwNumberOfProcessors;
+}
 
-#define download_query_size ((size_t) -1)
+// monotonic clock, only meaningful for measuring durations
+static double get_time_seconds() {
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / frequency.QuadPart;
+}
 
-typedef void (*downloading_callback) (int bytes_read, int bytes_total, void *params);
+static size_t get_peak_memory_usage() {
+    PROCESS_MEMORY_COUNTERS counters;
+    counters.cb = sizeof(counters);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+}
 
-static int download_file(memory *mem, const char *url, size_t download_size, downloading_callback callback, void *params) {
-    memset(mem, 0, sizeof(memory));
+// SHA-256 goes through the system CNG provider, which uses the SHA extensions of the cpu when they are available
+typedef struct {
+    BCRYPT_ALG_HANDLE hAlgorithm;
+    BCRYPT_HASH_HANDLE hHash;
+} sha256_context;
+
+static BOOL sha256_init(sha256_context *ctx) {
+    memset(ctx, 0, sizeof(sha256_context));
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&ctx->hAlgorithm, BCRYPT_SHA256_ALGORITHM, NULL, 0))) {
+        ctx->hAlgorithm = NULL;
+        return FALSE;
+    }
+    if (!BCRYPT_SUCCESS(BCryptCreateHash(ctx->hAlgorithm, &ctx->hHash, NULL, 0, NULL, 0, 0))) {
+        BCryptCloseAlgorithmProvider(ctx->hAlgorithm, 0);
+        memset(ctx, 0, sizeof(sha256_context));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void sha256_update(sha256_context *ctx, const char *data, size_t nbytes) {
+    while (nbytes != 0) {
+        ULONG chunk_size = (ULONG) min(nbytes, (size_t) 0x40000000);
+        BCryptHashData(ctx->hHash, (PUCHAR) data, chunk_size, 0);
+        data += chunk_size;
+        nbytes -= chunk_size;
+    }
+}
+
+static void sha256_final_hex(sha256_context *ctx, char *hex) {
+    UCHAR digest[32];
+    BCryptFinishHash(ctx->hHash, digest, sizeof(digest), 0);
+    for (int i=0; i<32; ++i) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+}
 
+static void sha256_free(sha256_context *ctx) {
+    if (ctx->hHash) BCryptDestroyHash(ctx->hHash);
+    if (ctx->hAlgorithm) BCryptCloseAlgorithmProvider(ctx->hAlgorithm, 0);
+    memset(ctx, 0, sizeof(sha256_context));
+}
+
+// a single session is shared by every request, so that connections to the same host are kept alive and reused
+typedef struct {
+    HINTERNET hInternet;
+} http_session;
+
+static int http_session_open(http_session *session, const http_session_config *config) {
+    session->hInternet = InternetOpenA(
+        config->user_agent,
+        *config->proxy ? INTERNET_OPEN_TYPE_PROXY : INTERNET_OPEN_TYPE_DIRECT,
+        *config->proxy ? config->proxy : NULL,
+        NULL,
+        0
+    );
+    if (!session->hInternet) {
+        return error_cant_init_inet;
+    }
+
+    DWORD timeout = (DWORD) config->timeout_ms;
+    InternetSetOptionA(session->hInternet, INTERNET_OPTION_CONNECT_TIMEOUT, &timeout, sizeof(timeout));
+    InternetSetOptionA(session->hInternet, INTERNET_OPTION_SEND_TIMEOUT, &timeout, sizeof(timeout));
+    InternetSetOptionA(session->hInternet, INTERNET_OPTION_RECEIVE_TIMEOUT, &timeout, sizeof(timeout));
+    return error_ok;
+}
+
+static void http_session_close(http_session *session) {
+    if (session->hInternet) {
+        InternetCloseHandle(session->hInternet);
+        session->hInternet = NULL;
+    }
+}
+
+// the response is passed to sink as it arrives.
+// if range is not NULL only the bytes in [begin, end) are requested, guarded by etag if it is known;
+// error_range_ignored is returned if the server answers with the whole file instead.
+// if if_none_match is not NULL the request is conditional and error_not_modified is returned on a 304 response.
+// the ETag of the response is stored back in etag. WinInet resolves and connects inside InternetOpenUrl,
+// so only the time to the first byte and the total time are known
+static int download_file_impl(http_session *session, byte_sink *sink, const char *url, size_t download_size, const byte_range *range, const char *if_none_match, char *etag, downloading_callback callback, void *params, http_timing *timing) {
     int errcode = error_ok;
 
-    HINTERNET hInternet = NULL;
+    double start_time = get_time_seconds();
+    if (timing) {
+        timing->dns_time = -1;
+        timing->connect_time = -1;
+        timing->first_byte_time = -1;
+        timing->bytes_read = 0;
+    }
+
+    HINTERNET hInternet = session->hInternet;
     HINTERNET hConnect = NULL;
 
-    char buffer[BUFFER_SIZE];
-    DWORD bytes_to_read = BUFFER_SIZE;
+    char buffer[STRING_SIZE];
+    DWORD bytes_to_read = STRING_SIZE;
     DWORD bytes_read = 0;
 
-    if (!(hInternet = InternetOpen(
-        "Mozilla/5.0",
-        INTERNET_OPEN_TYPE_DIRECT,
-        NULL,
-        NULL,
-        0
-    ))) {
+    if (!hInternet) {
         errcode = error_cant_init_inet;
         goto finish;
     }
 
-    if (!(hConnect = InternetOpenUrlA(hInternet, url, NULL, 0, 0, (DWORD_PTR) NULL))) {
+    char headers[STRING_SIZE * 2] = {0};
+    if (range) {
+        int headers_len = snprintf(headers, sizeof(headers), "Range: bytes=%llu-%llu\r\n",
+            (unsigned long long) range->begin, (unsigned long long) range->end - 1);
+        if (etag && *etag) {
+            snprintf(headers + headers_len, sizeof(headers) - headers_len, "If-Range: %s\r\n", etag);
+        }
+    } else if (if_none_match && *if_none_match) {
+        snprintf(headers, sizeof(headers), "If-None-Match: %s\r\n", if_none_match);
+    }
+
+    // responses are not written to the WinInet cache, revalidation is done with explicit ETags
+    DWORD flags = INTERNET_FLAG_KEEP_CONNECTION | INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_RELOAD;
+    if (!(hConnect = InternetOpenUrlA(hInternet, url, *headers ? headers : NULL, (DWORD) -1, flags, (DWORD_PTR) NULL))) {
         errcode = error_cant_access_site;
         goto finish;
     }
@@ -57,17 +204,33 @@ static int download_file(memory *mem, const char *url, size_t download_size, dow
         errcode = error_cant_access_site;
         goto finish;
     }
-    if (strcmp(buffer, "200") != 0) {
+    if (range && strcmp(buffer, "200") == 0) {
+        errcode = error_range_ignored;
+        goto finish;
+    } else if (if_none_match && strcmp(buffer, "304") == 0) {
+        errcode = error_not_modified;
+        goto finish;
+    } else if (strcmp(buffer, range ? "206" : "200") != 0) {
         errcode = error_cant_access_site;
         goto finish;
     }
 
-    if (download_size != download_query_size) {
-        mem->capacity = download_size;
-        mem->data = malloc(download_size);
+    if (timing) {
+        timing->first_byte_time = get_time_seconds() - start_time;
+    }
+
+    if (etag) {
+        bytes_to_read = STRING_SIZE;
+        if (!HttpQueryInfo(hConnect, HTTP_QUERY_ETAG, etag, &bytes_to_read, 0)) {
+            *etag = '\0';
+        }
     }
 
-    size_t remaining_bytes = download_size;
+    size_t total_bytes_read = range ? range->begin : 0;
+    size_t remaining_bytes = range ? range->end - range->begin : download_size;
+
+    // reads start small and grow while they keep filling up, up to MAX_READ_SIZE
+    size_t read_size = MIN_READ_SIZE;
     while (1) {
         bytes_to_read = 0;
         bytes_read = 0;
@@ -77,41 +240,62 @@ static int download_file(memory *mem, const char *url, size_t download_size, dow
                 errcode = error_cant_access_site;
                 goto finish;
             }
+            if (bytes_to_read == 0) {
+                break;
+            }
+            bytes_to_read = max(bytes_to_read, read_size);
         } else {
-            bytes_to_read = remaining_bytes;
+            bytes_to_read = min(remaining_bytes, read_size);
+            if (bytes_to_read == 0) {
+                break;
+            }
         }
 
-        if (bytes_to_read > BUFFER_SIZE) {
-            bytes_to_read = BUFFER_SIZE;
-        } else if (bytes_to_read == 0) {
-            break;
+        size_t reserved_size = bytes_to_read;
+        char *data = sink->reserve(sink, &reserved_size);
+        if (!data || reserved_size == 0) {
+            errcode = error_cant_write_file;
+            goto finish;
         }
+        bytes_to_read = min(bytes_to_read, reserved_size);
 
-        memset(buffer, 0, BUFFER_SIZE);
-        if (!InternetReadFile(hConnect, buffer, bytes_to_read, &bytes_read)) {
+        if (!InternetReadFile(hConnect, data, bytes_to_read, &bytes_read)) {
             errcode = error_cant_access_site;
             goto finish;
         }
+        if (bytes_read == 0) {
+            if (download_size != download_query_size) {
+                // the connection was closed before the expected size was reached
+                errcode = error_cant_access_site;
+            }
+            break;
+        }
 
-        if (mem->size + bytes_read > mem->capacity) {
-            mem->data = realloc(mem->data, mem->size + bytes_read);
-            mem->capacity = mem->size + bytes_read;
+        if ((errcode = sink->commit(sink, data, bytes_read)) != error_ok) {
+            goto finish;
+        }
+        total_bytes_read += bytes_read;
+        if (timing) {
+            timing->bytes_read += bytes_read;
         }
-        memcpy(mem->data + mem->size, buffer, bytes_read);
-        mem->size += bytes_read;
 
         if (callback) {
-            callback(mem->size, download_size, params);
+            callback(total_bytes_read, download_size, params);
         }
 
         if (download_size != download_query_size) {
             remaining_bytes -= bytes_read;
         }
+        if (bytes_read == bytes_to_read && read_size < MAX_READ_SIZE) {
+            read_size *= 2;
+        }
     }
 
 finish:
     if (hConnect) InternetCloseHandle(hConnect);
-    if (hInternet) InternetCloseHandle(hInternet);
+    if (timing) {
+        timing->total_time = get_time_seconds() - start_time;
+    }
     return errcode;
 }
 
@@ -167,22 +351,146 @@ static int file_exists(const char *filename) {
     return PathFileExistsA(filename);
 }
 
+static BOOL move_file(const char *from, const char *to) {
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+}
+
+static void remove_file(const char *filename) {
+    DeleteFileA(filename);
+}
+
+// removes a directory with everything in it
+static void remove_dir(const char *filename) {
+    char pattern[MAX_PATH];
+    snprintf(pattern, MAX_PATH, "%s\\*", filename);
+
+    WIN32_FIND_DATAA data;
+    HANDLE hFind = FindFirstFileA(pattern, &data);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
+
+            char path[MAX_PATH];
+            snprintf(path, MAX_PATH, "%s\\%s", filename, data.cFileName);
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                remove_dir(path);
+            } else {
+                DeleteFileA(path);
+            }
+        } while (FindNextFileA(hFind, &data));
+        FindClose(hFind);
+    }
+    RemoveDirectoryA(filename);
+}
+
 static BOOL is_directory(const char *filename) {
     DWORD attr = GetFileAttributesA(filename);
     return (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
 }
 
-static int get_file_size(const char *filename) {
-    if (!file_exists(filename)) return 0;
+// 0 if the file does not exist
+static unsigned long long get_file_size(const char *filename) {
+    HANDLE hFile = CreateFileA(filename, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return 0;
 
-    WIN32_FILE_ATTRIBUTE_DATA fad;
-    if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &fad))
-        return -1;
-    
     LARGE_INTEGER size;
-    size.HighPart = fad.nFileSizeHigh;
-    size.LowPart = fad.nFileSizeLow;
-    return size.QuadPart;
+    BOOL ret = GetFileSizeEx(hFile, &size);
+    CloseHandle(hFile);
+    return ret ? (unsigned long long) size.QuadPart : 0;
+}
+
+// the modification time is in microseconds since the epoch, on every platform
+static BOOL get_file_info(const char *filename, unsigned long long *size, unsigned long long *mtime) {
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &fad) || (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return FALSE;
+    }
+
+    *size = ((unsigned long long) fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    // file times count 100 ns intervals since 1601
+    unsigned long long file_time = ((unsigned long long) fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    *mtime = (file_time - 116444736000000000ULL) / 10;
+    return TRUE;
+}
+
+// reserves the disk space of a file that is about to be written, so that it is laid out in one piece instead of
+// growing one write at a time. unlike SetEndOfFile the size of the file is left as it is
+static void preallocate_file(FILE *file, size_t size) {
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = size;
+    SetFileInformationByHandle((HANDLE) _get_osfhandle(_fileno(file)), FileAllocationInfo, &info, sizeof(info));
+}
+
+// fseek takes a long, which only has 32 bits on windows
+static BOOL seek_file(FILE *file, unsigned long long offset) {
+    return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+}
+
+// the output of a segmented download is preallocated and mapped in memory, each segment reads directly into its own slice
+typedef struct {
+    HANDLE hFile;
+    HANDLE hMapping;
+    char *view;
+} mapped_file;
+
+// keep_contents reopens a partially downloaded file instead of starting from an empty one
+static BOOL map_output_file(mapped_file *file, const char *filename, size_t size, BOOL keep_contents) {
+    memset(file, 0, sizeof(mapped_file));
+
+    file->hFile = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, keep_contents ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->hFile == INVALID_HANDLE_VALUE) {
+        file->hFile = NULL;
+        return FALSE;
+    }
+
+    LARGE_INTEGER file_size;
+    file_size.QuadPart = size;
+    if (!SetFilePointerEx(file->hFile, file_size, NULL, FILE_BEGIN) || !SetEndOfFile(file->hFile)) {
+        return FALSE;
+    }
+
+    file->hMapping = CreateFileMappingA(file->hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+    if (!file->hMapping) {
+        return FALSE;
+    }
+
+    file->view = (char *) MapViewOfFile(file->hMapping, FILE_MAP_WRITE, 0, 0, size);
+    return file->view != NULL;
+}
+
+// SetEndOfFile already allocated the whole file
+static void preallocate_output_file(mapped_file *file) {
+}
+
+static void unmap_output_file(mapped_file *file) {
+    if (file->view) UnmapViewOfFile(file->view);
+    if (file->hMapping) CloseHandle(file->hMapping);
+    if (file->hFile) CloseHandle(file->hFile);
+    memset(file, 0, sizeof(mapped_file));
+}
+
+typedef const char * (__stdcall *client_version_fun_t)(void);
+
+// only needed for installs that predate the version manifest
+static BOOL probe_client_version(const char *base_dir, char *client_commit, char *cards_commit) {
+    if (!file_exists(base_dir)) {
+        return FALSE;
+    }
+    SetDllDirectory(base_dir);
+    HINSTANCE lib = LoadLibrary(CLIENT_LIBRARY_NAME);
+    if (lib == NULL) {
+        return FALSE;
+    }
+    client_version_fun_t fun = (client_version_fun_t) GetProcAddress(lib, "get_client_commit_hash");
+    if (fun) {
+        strncpy(client_commit, (*fun)(), STRING_SIZE - 1);
+    }
+    fun = (client_version_fun_t) GetProcAddress(lib, "get_cards_commit_hash");
+    if (fun) {
+        strncpy(cards_commit, (*fun)(), STRING_SIZE - 1);
+    }
+    FreeLibrary(lib);
+    return TRUE;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""End to end benchmark of the update path, against a local stand-in of github.
+
+A synthetic release is served by standin_server.py and banglauncher-cli runs these scenarios in one install directory:
+  cold-install   nothing installed, the release is downloaded and extracted
+  no-op          the same release is installed, only the release check runs
+  incremental    a new release where a few data files changed, only their zip entries are downloaded
+
+Each run reports the release check latency, download and extraction throughput, peak memory and the time until the
+client would be launched. The thresholds of bench_thresholds.json are passed on to banglauncher-cli, which exits with
+EXIT_REGRESSION when one is not met; so does this script, after every scenario has run.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import make_release
+import standin_server
+
+EXIT_REGRESSION = 100
+MEGABYTE = 1024 * 1024
+
+# lines printed by banglauncher-cli
+METRICS = [
+    ("check_time", re.compile(r"^Release check: ([\d.]+) s")),
+    ("download_rate", re.compile(r"^Download (?:update\.zip|delta): \d+ bytes in [\d.]+ s, ([\d.]+) MB/s")),
+    ("download_bytes", re.compile(r"^Download (?:update\.zip|delta): (\d+) bytes")),
+    ("cards_rate", re.compile(r"^Download cards\.pak: \d+ bytes in [\d.]+ s, ([\d.]+) MB/s")),
+    ("unzip_rate", re.compile(r"^(?:Extract|Patch): \d+ bytes \(\d+ unchanged\) in [\d.]+ s, ([\d.]+) MB/s")),
+    ("total_time", re.compile(r"^Time to launch: ([\d.]+) s")),
+    ("peak_memory", re.compile(r"^Peak memory: ([\d.]+) MB")),
+]
+
+COLUMNS = [
+    ("scenario", "%-12s", "scenario"),
+    ("check_time", "%9.3f", "check s"),
+    ("download_rate", "%10.1f", "dl MB/s"),
+    ("unzip_rate", "%10.1f", "unzip MB/s"),
+    ("peak_memory", "%8.1f", "peak MB"),
+    ("total_time", "%9.3f", "launch s"),
+    ("served_mb", "%10.1f", "served MB"),
+    ("requests", "%8d", "requests"),
+]
+
+
+def run_cli(args, server, install_dir, scenario, thresholds):
+    command = [args.cli, "--base-url", server.url, "--dir", install_dir]
+    if args.segments:
+        command += ["--segments", str(args.segments)]
+    for name, value in thresholds.get(scenario, {}).items():
+        command += ["--" + name, str(value)]
+
+    # the release cache must not hide the release check
+    env = {name: value for name, value in os.environ.items() if name != "BANG_RELEASE_CHECK_TTL"}
+
+    server.behaviour.reset_stats()
+    start = time.monotonic()
+    process = subprocess.run(command, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    wall_time = time.monotonic() - start
+    stats = server.behaviour.stats()
+
+    result = {"scenario": scenario, "exit_code": process.returncode, "wall_time": wall_time,
+              "served_mb": stats["bytes"] / MEGABYTE, "requests": stats["requests"], "regressions": []}
+    for line in process.stdout.splitlines():
+        for name, pattern in METRICS:
+            match = pattern.match(line)
+            if match:
+                result[name] = float(match.group(1))
+        if line.startswith("Regression: "):
+            result["regressions"].append(line[len("Regression: "):])
+    if args.verbose or process.returncode not in (0, EXIT_REGRESSION):
+        print(process.stdout, end="")
+    return result
+
+
+def print_table(results):
+    print(" ".join(header.rjust(len(fmt % 0)) if name != "scenario" else fmt % header for name, fmt, header in COLUMNS))
+    for result in results:
+        cells = []
+        for name, fmt, _ in COLUMNS:
+            value = result.get(name)
+            width = len(fmt % 0) if name != "scenario" else 12
+            cells.append(fmt % value if value is not None else "-".rjust(width))
+        print(" ".join(cells))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="end to end benchmark of the update path")
+    parser.add_argument("--cli", required=True, help="path of banglauncher-cli")
+    parser.add_argument("--repo", required=True, help="BANG_SDL_REPO_NAME that banglauncher-cli was built with")
+    parser.add_argument("--entries", type=int, default=500, help="number of files in the release zip")
+    parser.add_argument("--zip-size", type=float, default=64, help="uncompressed size of the release zip in MB")
+    parser.add_argument("--cards-size", type=float, default=32, help="size of cards.pak in MB")
+    parser.add_argument("--changed", type=int, default=10, help="data files changed by the incremental update")
+    parser.add_argument("--latency", type=float, default=0, help="milliseconds before each response")
+    parser.add_argument("--rate", type=float, default=0, help="throughput of each response in MB/s")
+    parser.add_argument("--segments", type=int, default=0, help="parallel connections per file")
+    parser.add_argument("--thresholds", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "bench_thresholds.json"),
+                        help="json of banglauncher-cli thresholds per scenario, none if empty")
+    parser.add_argument("--output", help="also write the results to this json file")
+    parser.add_argument("--keep", action="store_true", help="keep the served and install directories")
+    parser.add_argument("--verbose", action="store_true", help="print the output of banglauncher-cli")
+    args = parser.parse_args()
+
+    thresholds = {}
+    if args.thresholds:
+        with open(args.thresholds) as file_in:
+            thresholds = json.load(file_in)
+
+    work_dir = tempfile.mkdtemp(prefix="bang-bench-")
+    root = os.path.join(work_dir, "served")
+    install_dir = os.path.join(work_dir, "install")
+    os.makedirs(root)
+
+    server = standin_server.Server(root, args.latency / 1000, args.rate * MEGABYTE).start()
+    results = []
+    try:
+        zip_size = int(args.zip_size * MEGABYTE)
+        cards_size = int(args.cards_size * MEGABYTE)
+        print("release: %d entries, %.0f MB zip, %.0f MB cards.pak, latency %.0f ms, rate %s"
+              % (args.entries, args.zip_size, args.cards_size, args.latency, "%.1f MB/s" % args.rate if args.rate else "unlimited"))
+
+        make_release.make_release(root, server.url, args.repo, "v1", args.entries, zip_size, cards_size)
+        results.append(run_cli(args, server, install_dir, "cold-install", thresholds))
+        results.append(run_cli(args, server, install_dir, "no-op", thresholds))
+
+        # cards.pak stays the same, as it does for most client releases
+        make_release.make_release(root, server.url, args.repo, "v2", args.entries, zip_size, cards_size,
+                                  changed=args.changed, cards_version="v1")
+        release_zip_size = os.path.getsize(os.path.join(root, args.repo, "releases", "download", "v2", "bang-sdl.zip"))
+        results.append(run_cli(args, server, install_dir, "incremental", thresholds))
+    finally:
+        server.stop()
+        if args.keep:
+            print("kept %s" % work_dir)
+        else:
+            shutil.rmtree(work_dir, ignore_errors=True)
+
+    print_table(results)
+
+    failed = False
+    regressed = False
+    for result in results:
+        for regression in result["regressions"]:
+            print("%s: %s" % (result["scenario"], regression))
+        regressed |= result["exit_code"] == EXIT_REGRESSION
+        if result["exit_code"] not in (0, EXIT_REGRESSION):
+            print("%s: banglauncher-cli failed with exit code %d" % (result["scenario"], result["exit_code"]))
+            failed = True
+
+    # the incremental update must not fall back to the whole zip
+    incremental = results[-1]
+    if incremental["exit_code"] == 0 and incremental["served_mb"] * MEGABYTE >= release_zip_size / 2:
+        print("incremental: %.1f MB served, the update downloaded the whole release" % incremental["served_mb"])
+        regressed = True
+
+    if args.output:
+        with open(args.output, "w") as file_out:
+            json.dump(results, file_out, indent=2)
+
+    if failed:
+        return 1
+    return EXIT_REGRESSION if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
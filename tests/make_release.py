@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Writes a synthetic bang-sdl release into the directory served by standin_server.py.
+
+The layout follows the urls that the launcher requests from github:
+  repos/<repo>/releases/latest               the release json, with the game zip and cards.pak as its first two assets
+  repos/<repo>/git/trees/<commit>            the tree of the release commit, its resources entry points to
+  repos/<repo>/git/trees/<resources sha>     the resources tree, whose cards submodule gives the cards commit
+  <repo>/releases/download/<version>/...     the assets, at the same path as on github so that mirrors work too
+
+The zip holds a top level directory with the client library and num_entries - 1 data files, half of each is
+random and half repeats, so that they compress like game assets do. The data files only depend on the seed, except
+for the first --changed ones, so two releases of the same seed differ in those files and the client library.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import random
+import sys
+import zipfile
+
+CLIENT_LIBRARIES = {"posix": "libbangclient.so", "windows": "libbangclient.dll"}
+# the launcher only updates an install that has the client library of its own platform
+DEFAULT_PLATFORM = "windows" if sys.platform in ("win32", "cygwin", "msys") else "posix"
+
+
+def fake_sha(*parts):
+    return hashlib.sha1("/".join(str(part) for part in parts).encode()).hexdigest()
+
+
+def file_data(size, seed):
+    rng = random.Random(repr(seed))
+    random_part = rng.randbytes(size // 2)
+    pattern = rng.randbytes(64)
+    return random_part + (pattern * (size // 128 + 1))[:size - len(random_part)]
+
+
+def write_file(path, data):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "wb") as file_out:
+        file_out.write(data)
+
+
+def sha256_file(path):
+    digest = hashlib.sha256()
+    with open(path, "rb") as file_in:
+        for block in iter(lambda: file_in.read(1024 * 1024), b""):
+            digest.update(block)
+    return digest.hexdigest()
+
+
+def write_zip(path, version, num_entries, zip_size, seed, changed, platform):
+    """the first changed data files depend on the version, the others only on the seed"""
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    num_files = max(num_entries - 1, 1)
+    file_size = max(zip_size // num_files, 1)
+    top_dir = "bang-sdl-%s/" % version
+    with zipfile.ZipFile(path, "w", zipfile.ZIP_DEFLATED, compresslevel=6) as archive:
+        archive.writestr(top_dir + CLIENT_LIBRARIES[platform], file_data(64 * 1024, (seed, version, "client")))
+        for i in range(num_files):
+            file_seed = (seed, version, i) if i < changed else (seed, i)
+            archive.writestr(top_dir + "data/%03d/file_%05d.bin" % (i // 256, i), file_data(file_size, file_seed))
+
+
+def make_release(root, base_url, repo, version, num_entries, zip_size, cards_size, seed=1, changed=0,
+                 cards_version=None, platform=DEFAULT_PLATFORM):
+    """cards.pak is the same for the same cards_version. returns the release commit"""
+    commit = fake_sha(repo, version)
+    cards_version = cards_version or version
+    cards_commit = fake_sha(repo, "cards", cards_version)
+    resources_sha = fake_sha(repo, "resources", version)
+
+    download_dir = "%s/releases/download/%s" % (repo, version)
+    zip_path = os.path.join(root, download_dir, "bang-sdl.zip")
+    cards_path = os.path.join(root, download_dir, "cards.pak")
+    write_zip(zip_path, version, num_entries, zip_size, seed, changed, platform)
+    write_file(cards_path, random.Random(repr((seed, cards_version))).randbytes(cards_size))
+
+    def asset(asset_id, path):
+        name = os.path.basename(path)
+        return {
+            "url": "%s/repos/%s/releases/assets/%d" % (base_url, repo, asset_id),
+            "id": asset_id,
+            "name": name,
+            "label": "",
+            "uploader": {"login": "github-actions[bot]", "id": 41898282, "type": "Bot", "site_admin": False},
+            "content_type": "application/zip" if name.endswith(".zip") else "application/octet-stream",
+            "state": "uploaded",
+            "size": os.path.getsize(path),
+            "digest": "sha256:" + sha256_file(path),
+            "download_count": 0,
+            "browser_download_url": "%s/%s/%s" % (base_url, download_dir, name),
+        }
+
+    release = {
+        "url": "%s/repos/%s/releases/1" % (base_url, repo),
+        "html_url": "%s/%s/releases/tag/%s" % (base_url, repo, version),
+        "id": 1,
+        "tag_name": version,
+        "target_commitish": commit,
+        "name": version,
+        "draft": False,
+        "prerelease": False,
+        "assets": [asset(1, zip_path), asset(2, cards_path)],
+        "body": "Synthetic release with %d entries" % num_entries,
+    }
+
+    def tree_entry(path, entry_type, sha):
+        entry = {"path": path, "mode": "040000" if entry_type == "tree" else "160000", "type": entry_type, "sha": sha}
+        if entry_type == "tree":
+            entry["url"] = "%s/repos/%s/git/trees/%s" % (base_url, repo, sha)
+        return entry
+
+    tree = {"sha": commit, "tree": [tree_entry("resources", "tree", resources_sha), tree_entry("src", "tree", fake_sha(repo, "src", version))], "truncated": False}
+    resources = {"sha": resources_sha, "tree": [tree_entry("cards", "commit", cards_commit)], "truncated": False}
+
+    api_dir = os.path.join(root, "repos", repo)
+    write_file(os.path.join(api_dir, "git", "trees", commit), json.dumps(tree).encode())
+    write_file(os.path.join(api_dir, "git", "trees", resources_sha), json.dumps(resources).encode())
+    # written last, a launcher that sees the release finds everything it points to
+    write_file(os.path.join(api_dir, "releases", "latest"), json.dumps(release, indent=2).encode())
+    return commit
+
+
+def main():
+    parser = argparse.ArgumentParser(description="writes a synthetic release for the local github stand-in")
+    parser.add_argument("--root", required=True, help="directory served by standin_server.py")
+    parser.add_argument("--base-url", required=True, help="url of the stand-in")
+    parser.add_argument("--repo", required=True, help="owner/name, as BANG_SDL_REPO_NAME")
+    parser.add_argument("--version", default="v1")
+    parser.add_argument("--entries", type=int, default=500, help="number of files in the zip")
+    parser.add_argument("--zip-size", type=float, default=64, help="uncompressed size of the zip in MB")
+    parser.add_argument("--cards-size", type=float, default=32, help="size of cards.pak in MB")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--changed", type=int, default=0, help="data files that differ from the other releases of the same seed")
+    parser.add_argument("--cards-version", help="cards.pak is only rebuilt when this changes")
+    parser.add_argument("--platform", choices=sorted(CLIENT_LIBRARIES), default=DEFAULT_PLATFORM)
+    args = parser.parse_args()
+
+    commit = make_release(args.root, args.base_url.rstrip("/"), args.repo, args.version, args.entries,
+                          int(args.zip_size * 1024 * 1024), int(args.cards_size * 1024 * 1024), args.seed,
+                          args.changed, args.cards_version, args.platform)
+    print(commit)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,279 @@
+#!/usr/bin/env python3
+"""Local stand-in for github and the release mirrors, used by the tests and the benchmark.
+
+Each instance serves the files of the same root directory, with single byte ranges, If-Range, ETag and
+If-None-Match like github does. The github api is imitated with plain files: make_release.py writes
+repos/<owner>/<repo>/releases/latest and the git trees at the paths that the launcher requests.
+
+The behaviour of an instance can be changed while it runs:
+  GET /_control?latency=MS&rate=BYTES&slow=BYTES&slow_rate=BYTES&cut=BYTES&stall=BYTES&ranges=0
+      latency before each response, throughput of each response, throughput after that many bytes of each response,
+      connection closed or stalled after that many bytes of each response, ranges ignored.
+      the parameters that are left out are reset
+  GET /_stats      {"requests": n, "range_requests": n, "bytes": n} since the last /_stats?reset=1
+
+Run with a command after --, the instances are started, the command is run with BANG_TEST_SERVERS set to their
+base urls and BANG_TEST_ROOT to the served directory, and its exit code is returned.
+"""
+
+import argparse
+import http.server
+import json
+import os
+import shutil
+import socket
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+
+CHUNK_SIZE = 16 * 1024
+STALL_SECONDS = 60
+
+
+class Behaviour:
+    def __init__(self, latency=0.0, rate=0.0):
+        self.default_latency = latency
+        self.default_rate = rate
+        self.lock = threading.Lock()
+        self.released = threading.Event()
+        self.set({})
+        self.reset_stats()
+
+    def set(self, query):
+        # the stalled responses end when the behaviour changes
+        self.released.set()
+        self.released = threading.Event()
+
+        def number(name, default):
+            values = query.get(name)
+            return float(values[0]) if values else default
+
+        self.latency = number("latency", self.default_latency * 1000) / 1000
+        self.rate = number("rate", self.default_rate)
+        self.slow = int(number("slow", 0))
+        self.slow_rate = number("slow_rate", 0)
+        self.cut = int(number("cut", 0))
+        self.stall = int(number("stall", 0))
+        self.ranges = number("ranges", 1) != 0
+
+    def reset_stats(self):
+        with self.lock:
+            self.requests = 0
+            self.range_requests = 0
+            self.bytes = 0
+
+    def count(self, is_range):
+        with self.lock:
+            self.requests += 1
+            self.range_requests += 1 if is_range else 0
+
+    def add_bytes(self, nbytes):
+        with self.lock:
+            self.bytes += nbytes
+
+    def stats(self):
+        with self.lock:
+            return {"requests": self.requests, "range_requests": self.range_requests, "bytes": self.bytes}
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        # the headers and the first chunk go out in separate writes, which nagle would hold back for a delayed ack
+        self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def log_message(self, format, *args):
+        pass
+
+    def send_body(self, body, content_type="application/json"):
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_HEAD(self):
+        self.serve_file(head=True)
+
+    def do_GET(self):
+        url = urllib.parse.urlsplit(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        behaviour = self.server.behaviour
+        if url.path == "/_control":
+            behaviour.set(query)
+            self.send_body(b"ok", "text/plain")
+        elif url.path == "/_stats":
+            stats = behaviour.stats()
+            if query.get("reset"):
+                behaviour.reset_stats()
+            self.send_body(json.dumps(stats).encode())
+        else:
+            self.serve_file(head=False)
+
+    def find_file(self):
+        path = urllib.parse.unquote(urllib.parse.urlsplit(self.path).path).lstrip("/")
+        full_path = os.path.realpath(os.path.join(self.server.root, path))
+        if not full_path.startswith(self.server.root + os.sep) or not os.path.isfile(full_path):
+            return None
+        return full_path
+
+    def parse_range(self, size, etag):
+        header = self.headers.get("Range")
+        if not header or not self.server.behaviour.ranges or not header.startswith("bytes="):
+            return None
+        # a range for another version of the file is answered with the whole file
+        if_range = self.headers.get("If-Range")
+        if if_range and if_range != etag:
+            return None
+        first, _, last = header[6:].partition("-")
+        if "," in last or not first:
+            return None
+        begin = int(first)
+        end = min(int(last) + 1, size) if last else size
+        return (begin, end) if begin < end else None
+
+    def serve_file(self, head):
+        behaviour = self.server.behaviour
+        path = self.find_file()
+        if not path:
+            behaviour.count(False)
+            self.send_error(404)
+            return
+
+        stat = os.stat(path)
+        size = stat.st_size
+        etag = '"%x-%x"' % (stat.st_mtime_ns, size)
+        byte_range = self.parse_range(size, etag)
+        behaviour.count(byte_range is not None)
+
+        if behaviour.latency > 0:
+            time.sleep(behaviour.latency)
+
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        begin, end = byte_range if byte_range else (0, size)
+        self.send_response(206 if byte_range else 200)
+        if byte_range:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (begin, end - 1, size))
+        self.send_header("Content-Type", "application/json" if "/repos/" in self.path else "application/octet-stream")
+        self.send_header("Content-Length", str(end - begin))
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("ETag", etag)
+        self.end_headers()
+        if head:
+            return
+
+        rate, cut, stall = behaviour.rate, behaviour.cut, behaviour.stall
+        slow, slow_rate = behaviour.slow, behaviour.slow_rate
+        start_time = time.monotonic()
+        # bytes sent since the rate last changed
+        rate_start = 0
+        sent = 0
+        with open(path, "rb") as file_in:
+            file_in.seek(begin)
+            while begin + sent < end:
+                if cut and sent >= cut:
+                    self.close_connection = True
+                    return
+                if stall and sent >= stall:
+                    # the connection stays open without sending anything, until the client gives up
+                    behaviour.released.wait(STALL_SECONDS)
+                    self.close_connection = True
+                    return
+                if slow and sent == slow:
+                    rate = slow_rate
+                    start_time = time.monotonic()
+                    rate_start = sent
+                nbytes = min(CHUNK_SIZE, end - begin - sent)
+                if slow and sent < slow:
+                    nbytes = min(nbytes, slow - sent)
+                if cut:
+                    nbytes = min(nbytes, cut - sent)
+                if stall:
+                    nbytes = min(nbytes, stall - sent)
+                try:
+                    self.wfile.write(file_in.read(nbytes))
+                except OSError:
+                    self.close_connection = True
+                    return
+                sent += nbytes
+                behaviour.add_bytes(nbytes)
+                if rate > 0:
+                    delay = start_time + (sent - rate_start) / rate - time.monotonic()
+                    if delay > 0:
+                        time.sleep(delay)
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+    def __init__(self, root, latency=0.0, rate=0.0, port=0):
+        super().__init__(("127.0.0.1", port), Handler)
+        self.root = os.path.realpath(root)
+        self.behaviour = Behaviour(latency, rate)
+        self.thread = threading.Thread(target=self.serve_forever, daemon=True)
+
+    @property
+    def url(self):
+        return "http://127.0.0.1:%d" % self.server_address[1]
+
+    def start(self):
+        self.thread.start()
+        return self
+
+    def stop(self):
+        self.shutdown()
+        self.server_close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="local stand-in for github and the release mirrors")
+    parser.add_argument("--root", help="directory to serve, a temporary one by default")
+    parser.add_argument("--instances", type=int, default=1, help="number of servers on their own ports")
+    parser.add_argument("--port", type=int, default=0, help="port of the first instance")
+    parser.add_argument("--latency", type=float, default=0.0, help="seconds before each response")
+    parser.add_argument("--rate", type=float, default=0.0, help="bytes per second of each response")
+    parser.add_argument("command", nargs=argparse.REMAINDER, help="-- command to run against the servers")
+    args = parser.parse_args()
+
+    command = args.command[1:] if args.command[:1] == ["--"] else args.command
+    root = args.root or tempfile.mkdtemp(prefix="bang-standin-")
+    os.makedirs(root, exist_ok=True)
+
+    servers = []
+    for i in range(args.instances):
+        port = args.port + i if args.port else 0
+        servers.append(Server(root, args.latency, args.rate, port).start())
+    urls = " ".join(server.url for server in servers)
+
+    try:
+        if not command:
+            print("serving %s on %s" % (root, urls), flush=True)
+            while True:
+                time.sleep(3600)
+
+        env = dict(os.environ, BANG_TEST_SERVERS=urls, BANG_TEST_ROOT=root)
+        return subprocess.call(command, env=env)
+    except KeyboardInterrupt:
+        return 0
+    finally:
+        for server in servers:
+            server.stop()
+        if not args.root:
+            shutil.rmtree(root, ignore_errors=True)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
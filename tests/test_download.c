@@ -0,0 +1,174 @@
+#include "tests.h"
+#include "download.h"
+
+// single stream, ranged and segmented downloads from the stand-in, and resuming them after the server cuts them off
+
+#define TEST_FILE_SIZE (8 * 1024 * 1024)
+#define TEST_CUT_SIZE (1024 * 1024)
+
+static void cut_responses(size_t size) {
+    char query[STRING_SIZE];
+    snprintf(query, STRING_SIZE, "cut=%llu", (unsigned long long) size);
+    standin_control(0, query);
+}
+
+static BOOL is_zero(const char *data, size_t size) {
+    for (size_t i=0; i<size; ++i) {
+        if (data[i] != 0) return FALSE;
+    }
+    return TRUE;
+}
+
+static void test_single_stream(const char *data) {
+    memory mem;
+    CHECK_EQUAL(download_file(&mem, test_url(0, "download.bin"), TEST_FILE_SIZE, NULL, NULL), error_ok);
+    CHECK(mem.size == TEST_FILE_SIZE && memcmp(mem.data, data, TEST_FILE_SIZE) == 0);
+    free(mem.data);
+
+    // the size is not known upfront, as for api responses
+    CHECK_EQUAL(download_file(&mem, test_url(0, "download.bin"), download_query_size, NULL, NULL), error_ok);
+    CHECK(mem.size == TEST_FILE_SIZE && memcmp(mem.data, data, TEST_FILE_SIZE) == 0);
+    free(mem.data);
+}
+
+static void test_ranges(const char *data) {
+    char *buffer = (char *) calloc(TEST_FILE_SIZE, 1);
+    byte_range ranges[] = { { 100, 70000 }, { 5 * 1024 * 1024, 5 * 1024 * 1024 + 12345 } };
+
+    endpoint_list endpoints;
+    rank_endpoints(&endpoints, test_url(0, "download.bin"), TEST_FILE_SIZE);
+
+    standin_stats stats;
+    standin_read_stats(0, &stats);
+    CHECK_EQUAL(download_ranges(buffer, &endpoints, TEST_FILE_SIZE, ranges, 2, NULL, NULL), error_ok);
+    CHECK(memcmp(buffer + ranges[0].begin, data + ranges[0].begin, ranges[0].end - ranges[0].begin) == 0);
+    CHECK(memcmp(buffer + ranges[1].begin, data + ranges[1].begin, ranges[1].end - ranges[1].begin) == 0);
+    CHECK(is_zero(buffer, ranges[0].begin));
+    CHECK(is_zero(buffer + ranges[0].end, ranges[1].begin - ranges[0].end));
+
+    standin_read_stats(0, &stats);
+    CHECK_EQUAL(stats.range_requests, 2);
+    CHECK_EQUAL(stats.bytes, (ranges[0].end - ranges[0].begin) + (ranges[1].end - ranges[1].begin));
+
+    // nothing to fetch, nothing is requested
+    CHECK_EQUAL(download_ranges(buffer, &endpoints, TEST_FILE_SIZE, ranges, 0, NULL, NULL), error_ok);
+    standin_read_stats(0, &stats);
+    CHECK_EQUAL(stats.requests, 0);
+    free(buffer);
+}
+
+static void test_segmented(const char *data, const char *sha256) {
+    char path[MAX_PATH];
+    strncpy(path, test_path("segmented.out"), MAX_PATH);
+    remove_file(path);
+
+    standin_stats stats;
+    standin_read_stats(0, &stats);
+
+    char digest[SHA256_HEX_SIZE] = {0};
+    CHECK_EQUAL(download_file_to_disk(path, test_url(0, "download.bin"), TEST_FILE_SIZE, sha256, digest, NULL, NULL), error_ok);
+    CHECK(strcmp(digest, sha256) == 0);
+    CHECK(file_has_data(path, data, TEST_FILE_SIZE));
+    CHECK(!file_exists(test_path("segmented.out.journal")));
+
+    standin_read_stats(0, &stats);
+    CHECK_EQUAL(stats.range_requests, download_segments);
+    CHECK_EQUAL(stats.bytes, TEST_FILE_SIZE);
+}
+
+// each response is throttled, the segments only finish in time if they all run at once
+static void test_segments_parallel(const char *sha256) {
+    char path[MAX_PATH];
+    strncpy(path, test_path("parallel.out"), MAX_PATH);
+    remove_file(path);
+
+    char query[STRING_SIZE];
+    snprintf(query, STRING_SIZE, "rate=%d", TEST_FILE_SIZE / 4);
+    standin_control(0, query);
+    double start = get_time_seconds();
+    CHECK_EQUAL(download_file_to_disk(path, test_url(0, "download.bin"), TEST_FILE_SIZE, sha256, NULL, NULL, NULL), error_ok);
+    double time = elapsed_ms(start) / 1000.0;
+    standin_control(0, "");
+
+    // a second with the 4 segments in parallel, two if the first one ran alone
+    CHECK(time < 1.6);
+    remove_file(path);
+}
+
+// a server that answers ranges with the whole file gets a single stream
+static void test_ranges_ignored(const char *data, const char *sha256) {
+    char path[MAX_PATH];
+    strncpy(path, test_path("ignored.out"), MAX_PATH);
+    remove_file(path);
+
+    standin_control(0, "ranges=0");
+    CHECK_EQUAL(download_file_to_disk(path, test_url(0, "download.bin"), TEST_FILE_SIZE, sha256, NULL, NULL, NULL), error_ok);
+    CHECK(file_has_data(path, data, TEST_FILE_SIZE));
+    standin_control(0, "");
+}
+
+// every response is cut short, so the segments and the single stream that follows them all fail.
+// the next call goes on from the journal instead of starting over
+static void test_resume(const char *data, const char *sha256) {
+    char path[MAX_PATH];
+    strncpy(path, test_path("resumed.out"), MAX_PATH);
+    remove_file(path);
+
+    cut_responses(TEST_CUT_SIZE);
+    CHECK(download_file_to_disk(path, test_url(0, "download.bin"), TEST_FILE_SIZE, sha256, NULL, NULL, NULL) != error_ok);
+    CHECK(file_exists(test_path("resumed.out.journal")));
+    standin_control(0, "");
+
+    standin_stats stats;
+    standin_read_stats(0, &stats);
+    CHECK_EQUAL(download_file_to_disk(path, test_url(0, "download.bin"), TEST_FILE_SIZE, sha256, NULL, NULL, NULL), error_ok);
+    CHECK(file_has_data(path, data, TEST_FILE_SIZE));
+    CHECK(!file_exists(test_path("resumed.out.journal")));
+
+    standin_read_stats(0, &stats);
+    CHECK(stats.bytes < TEST_FILE_SIZE / 2);
+}
+
+// the file changes on the server between the two calls, the etag no longer matches and the download starts over
+static void test_resume_changed_file(const char *sha256) {
+    char path[MAX_PATH];
+    strncpy(path, test_path("changed.out"), MAX_PATH);
+    remove_file(path);
+
+    cut_responses(TEST_CUT_SIZE);
+    CHECK(download_file_to_disk(path, test_url(0, "changed.bin"), TEST_FILE_SIZE, "", NULL, NULL, NULL) != error_ok);
+    standin_control(0, "");
+
+    char *new_data = make_test_data(TEST_FILE_SIZE, 2);
+    char new_sha256[SHA256_HEX_SIZE];
+    sha256_hex(new_data, TEST_FILE_SIZE, new_sha256);
+    sleep_ms(10);
+    CHECK(write_test_file("changed.bin", new_data, TEST_FILE_SIZE));
+
+    char digest[SHA256_HEX_SIZE] = {0};
+    CHECK_EQUAL(download_file_to_disk(path, test_url(0, "changed.bin"), TEST_FILE_SIZE, "", digest, NULL, NULL), error_ok);
+    CHECK(strcmp(digest, new_sha256) == 0);
+    CHECK(strcmp(digest, sha256) != 0);
+    CHECK(file_has_data(path, new_data, TEST_FILE_SIZE));
+    free(new_data);
+}
+
+void test_download() {
+    char *data = make_test_data(TEST_FILE_SIZE, 1);
+    char sha256[SHA256_HEX_SIZE];
+    sha256_hex(data, TEST_FILE_SIZE, sha256);
+    CHECK(write_test_file("download.bin", data, TEST_FILE_SIZE));
+    CHECK(write_test_file("changed.bin", data, TEST_FILE_SIZE));
+
+    download_segments = 4;
+    test_single_stream(data);
+    test_ranges(data);
+    test_segmented(data, sha256);
+    test_segments_parallel(sha256);
+    test_ranges_ignored(data, sha256);
+    test_resume(data, sha256);
+    test_resume_changed_file(sha256);
+    download_segments = DOWNLOAD_SEGMENTS;
+
+    free(data);
+}
@@ -0,0 +1,225 @@
+#include <cjson/cJSON.h>
+
+#include "tests.h"
+#include "json_reader.h"
+#include "updater.h"
+
+// the pull parser on its own, then on responses recorded from the github api (tests/data),
+// and a benchmark of the release check parsers against a dom on large trees
+
+#define OLD_COMMIT "9a8b7c6d5e4f30211f0e9d8c7b6a5948372615f0"
+#define RELEASE_COMMIT "4f1c2a9e8b7d6c5b4a39281706f5e4d3c2b1a098"
+#define RESOURCES_URL "https://api.github.com/repos/owner/bang-sdl/git/trees/7c2e9b4d1a3f5e6c8b0d2a4f6e8c0b2d4f6a8c0e"
+#define CARDS_COMMIT "2b4d6f8a0c1e3f5a7b9d1e3f5a7c9e1b3d5f7a9c"
+
+static void test_tokens() {
+    const char *text = "{\"a\": [1, -2.5e3, true, null], \"b\": {\"c\": {}}, \"s\": \"x\\\"y\\\\z\\n\\u00e9\\ud83c\\udccf\", \"n\": 42}";
+    json_reader reader;
+    json_reader_init(&reader, text, strlen(text));
+
+    CHECK_EQUAL(json_next(&reader), JSON_OBJECT_BEGIN);
+    CHECK(json_next_member(&reader) && json_string_equals(&reader, "a"));
+    CHECK_EQUAL(json_next(&reader), JSON_ARRAY_BEGIN);
+    CHECK_EQUAL(json_next(&reader), JSON_NUMBER);
+    CHECK_EQUAL(json_next(&reader), JSON_NUMBER);
+    CHECK(reader.value_size == 6 && memcmp(reader.value, "-2.5e3", 6) == 0);
+    CHECK_EQUAL(json_next(&reader), JSON_LITERAL);
+    CHECK_EQUAL(json_next(&reader), JSON_LITERAL);
+    CHECK_EQUAL(json_next(&reader), JSON_ARRAY_END);
+
+    // nested values are skipped whole
+    CHECK(json_next_member(&reader) && json_string_equals(&reader, "b"));
+    CHECK(json_skip_member(&reader));
+
+    char value[STRING_SIZE];
+    CHECK(json_next_member(&reader) && json_string_equals(&reader, "s"));
+    CHECK(json_read_string(&reader, value, STRING_SIZE));
+    CHECK(strcmp(value, "x\"y\\z\n\xc3\xa9\xf0\x9f\x83\x8f") == 0);
+
+    // strings are cut to fit, a code point is not split
+    json_reader_init(&reader, text, strlen(text));
+    json_next(&reader);
+    while (json_next_member(&reader) && !json_string_equals(&reader, "s")) {
+        json_skip_member(&reader);
+    }
+    CHECK(json_read_string(&reader, value, 7));
+    CHECK(strcmp(value, "x\"y\\z\n") == 0);
+
+    size_t number = 0;
+    CHECK(json_next_member(&reader) && json_string_equals(&reader, "n"));
+    CHECK(json_read_size(&reader, &number));
+    CHECK_EQUAL(number, 42);
+    CHECK(!json_next_member(&reader));
+    CHECK_EQUAL(reader.type, JSON_OBJECT_END);
+    CHECK_EQUAL(json_next(&reader), JSON_END);
+
+    // a document that ends in the middle of a string is an error, and stays one
+    json_reader_init(&reader, text, 60);
+    json_next(&reader);
+    while (json_next_member(&reader)) {
+        json_skip_member(&reader);
+    }
+    CHECK_EQUAL(reader.type, JSON_ERROR);
+    CHECK_EQUAL(json_next(&reader), JSON_ERROR);
+}
+
+static void test_release(const memory *release) {
+    CHECK_EQUAL(parse_bang_release(release->data, release->size, OLD_COMMIT), error_ok);
+    CHECK(strcmp(bang_zip_information.version, "v1.4.2") == 0);
+    CHECK(strcmp(bang_zip_information.commit, RELEASE_COMMIT) == 0);
+
+    CHECK(strcmp(bang_zip_information.zip_url, "https://github.com/owner/bang-sdl/releases/download/v1.4.2/bang-sdl.zip") == 0);
+    CHECK_EQUAL(bang_zip_information.zip_size, 48213504);
+    CHECK(strcmp(bang_zip_information.zip_sha256, "3b7e1f0c2d9a8e6f5b4c3a2918d7e6f5c4b3a29180f7e6d5c4b3a2918e7f6d5c") == 0);
+
+    CHECK(strcmp(bang_zip_information.cards_pak_url, "https://github.com/owner/bang-sdl/releases/download/v1.4.2/cards.pak") == 0);
+    CHECK_EQUAL(bang_zip_information.cards_pak_size, 73400320);
+    CHECK(strcmp(bang_zip_information.cards_index_url, "https://github.com/owner/bang-sdl/releases/download/v1.4.2/cards.pak.chunks") == 0);
+
+    // the delta is named after the abbreviated installed commit
+    CHECK(strcmp(bang_zip_information.delta_from_commit, OLD_COMMIT) == 0);
+    CHECK(strcmp(bang_zip_information.delta_url, "https://github.com/owner/bang-sdl/releases/download/v1.4.2/delta-9a8b7c6.zip") == 0);
+    CHECK_EQUAL(bang_zip_information.delta_size, 3145728);
+
+    CHECK_EQUAL(parse_bang_release(release->data, release->size, RELEASE_COMMIT), error_ok);
+    CHECK(*bang_zip_information.delta_url == '\0');
+
+    // a response cut short is not taken for a release without assets
+    CHECK_EQUAL(parse_bang_release(release->data, release->size / 2, OLD_COMMIT), error_cant_parse_json);
+
+    const char *no_assets = "{\"name\": \"v1\", \"target_commitish\": \"main\", \"assets\": []}";
+    CHECK_EQUAL(parse_bang_release(no_assets, strlen(no_assets), ""), error_no_release_found);
+}
+
+static void test_trees(const memory *tree, const memory *resources_tree) {
+    char value[STRING_SIZE] = {0};
+    CHECK(find_tree_field(tree->data, tree->size, "resources", "url", value));
+    CHECK(strcmp(value, RESOURCES_URL) == 0);
+
+    CHECK(find_tree_field(resources_tree->data, resources_tree->size, "cards", "sha", value));
+    CHECK(strcmp(value, CARDS_COMMIT) == 0);
+
+    // the cards submodule has no url, and the resources tree no cards
+    CHECK(!find_tree_field(resources_tree->data, resources_tree->size, "cards", "url", value));
+    CHECK(!find_tree_field(tree->data, tree->size, "cards", "sha", value));
+    CHECK(!find_tree_field(tree->data, tree->size / 2, "src", "sha", value));
+}
+
+void test_json_reader() {
+    test_tokens();
+
+    memory release = {0};
+    memory tree = {0};
+    memory resources_tree = {0};
+    BOOL has_data = read_test_data("github_release.json", &release)
+        && read_test_data("github_tree.json", &tree)
+        && read_test_data("github_resources_tree.json", &resources_tree);
+    CHECK(has_data);
+    if (has_data) {
+        test_release(&release);
+        test_trees(&tree, &resources_tree);
+    }
+    free(release.data);
+    free(tree.data);
+    free(resources_tree.data);
+}
+
+// a tree of num_entries entries like those of the fixture, with the one that is looked for at the end,
+// as in a repository with many files at its root
+static char *make_large_tree(const memory *tree, int num_entries, size_t *size) {
+    cJSON *json = cJSON_ParseWithLength(tree->data, tree->size);
+    cJSON *entries = json ? cJSON_GetObjectItemCaseSensitive(json, "tree") : NULL;
+    cJSON *resources = NULL;
+    cJSON *entry;
+    cJSON_ArrayForEach(entry, entries) {
+        const char *path = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(entry, "path"));
+        if (path && strcmp(path, "resources") == 0) {
+            resources = entry;
+        }
+    }
+    if (!resources) {
+        cJSON_Delete(json);
+        return NULL;
+    }
+    cJSON_DetachItemViaPointer(entries, resources);
+
+    cJSON *sample = cJSON_GetArrayItem(entries, 0);
+    for (int i=cJSON_GetArraySize(entries); i<num_entries - 1; ++i) {
+        char path[STRING_SIZE];
+        snprintf(path, STRING_SIZE, "assets/generated/file_%06d.png", i);
+        cJSON *copy = cJSON_Duplicate(sample, TRUE);
+        cJSON_ReplaceItemInObjectCaseSensitive(copy, "path", cJSON_CreateString(path));
+        cJSON_AddItemToArray(entries, copy);
+    }
+    cJSON_AddItemToArray(entries, resources);
+
+    char *text = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    *size = text ? strlen(text) : 0;
+    return text;
+}
+
+static BOOL find_tree_field_dom(const char *data, size_t size, const char *path, const char *field, char *dest) {
+    cJSON *json = cJSON_ParseWithLength(data, size);
+    BOOL found = FALSE;
+    cJSON *entry;
+    cJSON_ArrayForEach(entry, cJSON_GetObjectItemCaseSensitive(json, "tree")) {
+        const char *entry_path = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(entry, "path"));
+        const char *value = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(entry, field));
+        if (entry_path && value && strcmp(entry_path, path) == 0) {
+            strncpy(dest, value, STRING_SIZE);
+            found = TRUE;
+            break;
+        }
+    }
+    cJSON_Delete(json);
+    return found;
+}
+
+#define BENCH_REPEATS 5
+
+// the timings are only reported, the results of both parsers are checked
+void bench_json_reader() {
+    memory tree = {0};
+    memory release = {0};
+    CHECK(read_test_data("github_tree.json", &tree) && read_test_data("github_release.json", &release));
+
+    static const int sizes[] = { 1000, 10000, 100000 };
+    printf("%-10s %10s %14s %14s\n", "entries", "size (KB)", "reader (ms)", "cJSON (ms)");
+    for (size_t i=0; i<sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t size = 0;
+        char *text = make_large_tree(&tree, sizes[i], &size);
+        CHECK(text != NULL);
+        if (!text) break;
+
+        double reader_time = 0;
+        double dom_time = 0;
+        for (int j=0; j<BENCH_REPEATS; ++j) {
+            char value[STRING_SIZE] = {0};
+            double start = get_time_seconds();
+            CHECK(find_tree_field(text, size, "resources", "url", value) && strcmp(value, RESOURCES_URL) == 0);
+            double time = elapsed_ms(start);
+            reader_time = j == 0 ? time : min(reader_time, time);
+
+            memset(value, 0, STRING_SIZE);
+            start = get_time_seconds();
+            CHECK(find_tree_field_dom(text, size, "resources", "url", value) && strcmp(value, RESOURCES_URL) == 0);
+            time = elapsed_ms(start);
+            dom_time = j == 0 ? time : min(dom_time, time);
+        }
+        printf("%-10d %10llu %14.3f %14.3f\n", sizes[i], (unsigned long long) (size >> 10), reader_time, dom_time);
+        cJSON_free(text);
+    }
+
+    double release_time = 0;
+    for (int j=0; j<BENCH_REPEATS; ++j) {
+        double start = get_time_seconds();
+        CHECK_EQUAL(parse_bang_release(release.data, release.size, OLD_COMMIT), error_ok);
+        double time = elapsed_ms(start);
+        release_time = j == 0 ? time : min(release_time, time);
+    }
+    printf("release (%llu KB): %.3f ms\n", (unsigned long long) (release.size >> 10), release_time);
+
+    free(tree.data);
+    free(release.data);
+}
@@ -0,0 +1,147 @@
+#include "tests.h"
+#include "download.h"
+
+// the origin and two mirrors are the three stand-ins, throttled differently. mirrors are only used for files with
+// an expected digest. the downloads run with the default segments, each watches its own throughput
+
+#define MIRROR_FILE_SIZE (24 * 1024 * 1024)
+#define MIRROR_SEGMENTS 4
+
+// the fast mirror slows down after this many bytes of each response, within each segment
+#define MIRROR_SLOW_AFTER (4 * 1024 * 1024)
+
+#define ORIGIN 0
+#define FAST_MIRROR 1
+#define SLOW_MIRROR 2
+
+static void set_mirrors(const char *fast_path, const char *slow_path) {
+    char base[STRING_SIZE];
+    num_download_mirrors = 0;
+    snprintf(base, STRING_SIZE, "%s%s", test_servers[FAST_MIRROR], fast_path);
+    add_download_mirror(base);
+    snprintf(base, STRING_SIZE, "%s%s", test_servers[SLOW_MIRROR], slow_path);
+    add_download_mirror(base);
+}
+
+static void read_all_stats(standin_stats *stats) {
+    for (int i=0; i<3; ++i) {
+        standin_read_stats(i, &stats[i]);
+    }
+}
+
+static void download_from_mirrors(const char *name, const char *data, const char *sha256) {
+    char path[MAX_PATH];
+    strncpy(path, test_path(name), MAX_PATH);
+    remove_file(path);
+
+    char digest[SHA256_HEX_SIZE] = {0};
+    CHECK_EQUAL(download_file_to_disk(path, test_url(ORIGIN, "mirrored.bin"), MIRROR_FILE_SIZE, sha256, digest, NULL, NULL), error_ok);
+    CHECK(strcmp(digest, sha256) == 0);
+    CHECK(file_has_data(path, data, MIRROR_FILE_SIZE));
+    remove_file(path);
+}
+
+// the fastest endpoint is used after the probes, the origin only serves its probe
+static void test_ranking(const char *data, const char *sha256) {
+    standin_control(ORIGIN, "rate=524288");
+    standin_control(SLOW_MIRROR, "rate=4194304");
+    set_mirrors("", "");
+
+    standin_stats stats[3];
+    read_all_stats(stats);
+    download_from_mirrors("ranked.out", data, sha256);
+    read_all_stats(stats);
+
+    CHECK(stats[ORIGIN].bytes <= MIRROR_PROBE_SIZE);
+    CHECK(stats[SLOW_MIRROR].bytes <= MIRROR_PROBE_SIZE);
+    CHECK(stats[FAST_MIRROR].bytes >= MIRROR_FILE_SIZE);
+}
+
+// the fast mirror drops to a fraction of its rate after two windows of the rate watch,
+// the rest of each segment comes from the next one
+static void test_slow_failover(const char *data, const char *sha256) {
+    char query[STRING_SIZE];
+    snprintf(query, STRING_SIZE, "rate=1048576&slow=%d&slow_rate=20480", MIRROR_SLOW_AFTER);
+    standin_control(FAST_MIRROR, query);
+    standin_control(ORIGIN, "rate=262144");
+    standin_control(SLOW_MIRROR, "rate=524288");
+    set_mirrors("", "");
+
+    standin_stats stats[3];
+    read_all_stats(stats);
+    double start = get_time_seconds();
+    download_from_mirrors("slow.out", data, sha256);
+    double time = elapsed_ms(start) / 1000.0;
+    read_all_stats(stats);
+
+    CHECK(stats[ORIGIN].bytes <= MIRROR_PROBE_SIZE);
+    CHECK(stats[FAST_MIRROR].bytes >= MIRROR_SEGMENTS * MIRROR_SLOW_AFTER && stats[FAST_MIRROR].bytes < MIRROR_FILE_SIZE);
+    CHECK(stats[SLOW_MIRROR].bytes >= MIRROR_FILE_SIZE - stats[FAST_MIRROR].bytes);
+    // the probe, then every segment
+    CHECK_EQUAL(stats[SLOW_MIRROR].range_requests, 1 + MIRROR_SEGMENTS);
+
+    // staying on the slowed down mirror would take more than a minute
+    CHECK(time < 30);
+}
+
+// the fast mirror stops sending without closing the connection, it is left once the stall times out
+static void test_stall_failover(const char *data, const char *sha256) {
+    char query[STRING_SIZE];
+    snprintf(query, STRING_SIZE, "stall=%d", MIRROR_SLOW_AFTER);
+    standin_control(FAST_MIRROR, query);
+    standin_control(ORIGIN, "rate=524288");
+    standin_control(SLOW_MIRROR, "rate=4194304");
+    set_mirrors("", "");
+
+    standin_stats stats[3];
+    read_all_stats(stats);
+    download_from_mirrors("stalled.out", data, sha256);
+    read_all_stats(stats);
+
+    CHECK_EQUAL(stats[FAST_MIRROR].bytes, MIRROR_SEGMENTS * MIRROR_SLOW_AFTER + MIRROR_PROBE_SIZE);
+    CHECK(stats[SLOW_MIRROR].bytes >= MIRROR_FILE_SIZE - MIRROR_SEGMENTS * MIRROR_SLOW_AFTER);
+}
+
+// a mirror without the file is left out after its probe, the download goes on from the others
+static void test_missing_mirror(const char *data, const char *sha256) {
+    standin_control(ORIGIN, "rate=4194304");
+    set_mirrors("/missing", "");
+
+    standin_stats stats[3];
+    read_all_stats(stats);
+    download_from_mirrors("missing.out", data, sha256);
+    read_all_stats(stats);
+
+    CHECK_EQUAL(stats[FAST_MIRROR].bytes, 0);
+    CHECK_EQUAL(stats[FAST_MIRROR].requests, 1);
+    CHECK(stats[SLOW_MIRROR].bytes >= MIRROR_FILE_SIZE);
+}
+
+static void reset_servers() {
+    for (int i=0; i<3; ++i) {
+        standin_control(i, "");
+    }
+}
+
+void test_mirrors() {
+    CHECK(num_test_servers >= 3);
+    if (num_test_servers < 3) return;
+
+    char *data = make_test_data(MIRROR_FILE_SIZE, 5);
+    char sha256[SHA256_HEX_SIZE];
+    sha256_hex(data, MIRROR_FILE_SIZE, sha256);
+    CHECK(write_test_file("mirrored.bin", data, MIRROR_FILE_SIZE));
+
+    download_segments = MIRROR_SEGMENTS;
+    test_ranking(data, sha256);
+    reset_servers();
+    test_slow_failover(data, sha256);
+    reset_servers();
+    test_stall_failover(data, sha256);
+    reset_servers();
+    test_missing_mirror(data, sha256);
+    download_segments = DOWNLOAD_SEGMENTS;
+    num_download_mirrors = 0;
+
+    free(data);
+}
@@ -0,0 +1,195 @@
+#include "tests.h"
+#include "download.h"
+
+// the sinks that downloads are read into, and a benchmark of the memory sink against the buffer that it replaced
+
+#define SINK_TEST_SIZE (16 * 1024 * 1024)
+
+// the size of the writes of curl, CURL_MAX_WRITE_SIZE
+#define SINK_CHUNK_SIZE (16 * 1024)
+
+// writes data through the sink in chunks of chunk_size, as download_file_impl does
+static int write_to_sink(byte_sink *sink, const char *data, size_t size, size_t chunk_size) {
+    size_t pos = 0;
+    while (pos < size) {
+        size_t reserved_size = min(chunk_size, size - pos);
+        char *dest = sink->reserve(sink, &reserved_size);
+        if (!dest || reserved_size == 0) return error_cant_write_file;
+
+        reserved_size = min(reserved_size, min(chunk_size, size - pos));
+        memcpy(dest, data + pos, reserved_size);
+        int errcode = sink->commit(sink, dest, reserved_size);
+        if (errcode != error_ok) return errcode;
+        pos += reserved_size;
+    }
+    return error_ok;
+}
+
+static void test_memory_sink(const char *data) {
+    memory mem = {0};
+    memory_sink sink;
+    memory_sink_init(&sink, &mem);
+
+    // small writes must not reallocate the buffer every time
+    int reallocs = 0;
+    size_t pos = 0;
+    while (pos < SINK_TEST_SIZE) {
+        size_t capacity = mem.capacity;
+        CHECK_EQUAL(write_to_sink(&sink.base, data + pos, BUFFER_SIZE, BUFFER_SIZE), error_ok);
+        reallocs += mem.capacity != capacity;
+        pos += BUFFER_SIZE;
+    }
+    CHECK(mem.size == SINK_TEST_SIZE && memcmp(mem.data, data, SINK_TEST_SIZE) == 0);
+    CHECK(reallocs <= 16);
+    CHECK(mem.capacity < 2 * SINK_TEST_SIZE);
+
+    // the region returned is at least as large as asked for
+    size_t size = 3 * SINK_TEST_SIZE;
+    CHECK(sink.base.reserve(&sink.base, &size) == mem.data + mem.size);
+    CHECK(size >= 3 * SINK_TEST_SIZE);
+    free(mem.data);
+}
+
+static void test_mapped_sink() {
+    char buffer[100];
+    mapped_sink sink;
+    mapped_sink_init(&sink, buffer, sizeof(buffer));
+
+    size_t size = 60;
+    CHECK(sink.base.reserve(&sink.base, &size) == buffer);
+    CHECK_EQUAL(size, 60);
+    CHECK_EQUAL(sink.base.commit(&sink.base, buffer, 60), error_ok);
+
+    // the region never goes past the end, and there is none once it is full
+    size = 60;
+    CHECK(sink.base.reserve(&sink.base, &size) == buffer + 60);
+    CHECK_EQUAL(size, 40);
+    CHECK_EQUAL(sink.base.commit(&sink.base, buffer + 60, 40), error_ok);
+
+    size = 1;
+    CHECK(sink.base.reserve(&sink.base, &size) == NULL);
+    CHECK_EQUAL(sink.pos, sizeof(buffer));
+}
+
+static void test_file_sink(const char *data) {
+    char path[MAX_PATH];
+    strncpy(path, test_path("sink.out"), MAX_PATH);
+
+    FILE *file_out = fopen(path, "wb");
+    CHECK(file_out != NULL);
+    if (!file_out) return;
+
+    file_sink sink;
+    CHECK(file_sink_init(&sink, file_out));
+
+    // reserve never hands out more than its buffer
+    size_t size = 2 * FILE_SINK_BUFFER_SIZE;
+    CHECK(sink.base.reserve(&sink.base, &size) != NULL);
+    CHECK_EQUAL(size, FILE_SINK_BUFFER_SIZE);
+
+    CHECK_EQUAL(write_to_sink(&sink.base, data, SINK_TEST_SIZE, SINK_CHUNK_SIZE), error_ok);
+    file_sink_free(&sink);
+    CHECK(fclose(file_out) == 0);
+
+    CHECK(file_has_data(path, data, SINK_TEST_SIZE));
+    remove_file(path);
+}
+
+static void test_tee_sink(const char *data) {
+    char expected[SHA256_HEX_SIZE];
+    sha256_hex(data, SINK_TEST_SIZE, expected);
+
+    memory mem = {0};
+    memory_sink target;
+    memory_sink_init(&target, &mem);
+
+    sha256_context ctx;
+    sha256_init(&ctx);
+    tee_sink sink;
+    tee_sink_init(&sink, &target.base, sha256_observer, &ctx);
+
+    CHECK_EQUAL(write_to_sink(&sink.base, data, SINK_TEST_SIZE, SINK_CHUNK_SIZE), error_ok);
+    char digest[SHA256_HEX_SIZE];
+    sha256_final_hex(&ctx, digest);
+    CHECK(strcmp(digest, expected) == 0);
+    CHECK(mem.size == SINK_TEST_SIZE && memcmp(mem.data, data, SINK_TEST_SIZE) == 0);
+    free(mem.data);
+}
+
+void test_sinks() {
+    char *data = make_test_data(SINK_TEST_SIZE, 3);
+    test_memory_sink(data);
+    test_mapped_sink();
+    test_file_sink(data);
+    test_tee_sink(data);
+    free(data);
+}
+
+// the buffer of download_file before the sinks: BUFFER_SIZE bytes are read into a cleared stack buffer,
+// then the response grows to the exact size and the bytes are copied after it
+static BOOL write_exact_realloc(memory *mem, const char *data, size_t size) {
+    char buffer[BUFFER_SIZE];
+    size_t pos = 0;
+    while (pos < size) {
+        size_t bytes_read = min(BUFFER_SIZE, size - pos);
+        memset(buffer, 0, BUFFER_SIZE);
+        memcpy(buffer, data + pos, bytes_read);
+
+        if (mem->size + bytes_read > mem->capacity) {
+            char *new_data = (char *) realloc(mem->data, mem->size + bytes_read);
+            if (!new_data) return FALSE;
+            mem->data = new_data;
+            mem->capacity = mem->size + bytes_read;
+        }
+        memcpy(mem->data + mem->size, buffer, bytes_read);
+        mem->size += bytes_read;
+        pos += bytes_read;
+    }
+    return TRUE;
+}
+
+#define BENCH_REPEATS 5
+
+// best of BENCH_REPEATS runs, in milliseconds
+static double bench_exact_realloc(const char *data, size_t size) {
+    double best = 0;
+    for (int i=0; i<BENCH_REPEATS; ++i) {
+        memory mem = {0};
+        double start = get_time_seconds();
+        CHECK(write_exact_realloc(&mem, data, size));
+        double time = elapsed_ms(start);
+        best = i == 0 ? time : min(best, time);
+        free(mem.data);
+    }
+    return best;
+}
+
+static double bench_memory_sink(const char *data, size_t size) {
+    double best = 0;
+    for (int i=0; i<BENCH_REPEATS; ++i) {
+        memory mem = {0};
+        memory_sink sink;
+        memory_sink_init(&sink, &mem);
+        double start = get_time_seconds();
+        CHECK_EQUAL(write_to_sink(&sink.base, data, size, SINK_CHUNK_SIZE), error_ok);
+        double time = elapsed_ms(start);
+        best = i == 0 ? time : min(best, time);
+        free(mem.data);
+    }
+    return best;
+}
+
+// the timings are only reported, they depend too much on the allocator and the machine to be checked
+void bench_sinks() {
+    static const size_t sizes[] = { 4 * 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024 };
+    char *data = make_test_data(sizes[2], 4);
+
+    printf("%-10s %14s %14s %8s\n", "payload", "realloc (ms)", "sink (ms)", "speedup");
+    for (size_t i=0; i<sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        double old_time = bench_exact_realloc(data, sizes[i]);
+        double new_time = bench_memory_sink(data, sizes[i]);
+        printf("%7llu MB %14.2f %14.2f %7.1fx\n", (unsigned long long) (sizes[i] >> 20), old_time, new_time,
+            old_time / max(new_time, 0.001));
+    }
+    free(data);
+}
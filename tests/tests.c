@@ -0,0 +1,204 @@
+#include "tests.h"
+#include "download.h"
+#include "json_reader.h"
+
+// runs the group of tests named on the command line, or all of them. the exit code is the number of failed checks
+
+int test_failures = 0;
+
+char test_servers[MAX_TEST_SERVERS][STRING_SIZE];
+int num_test_servers = 0;
+const char *test_root = NULL;
+
+void check_condition(BOOL condition, const char *text, const char *file, int line) {
+    if (!condition) {
+        printf("%s:%d: check failed: %s\n", file, line, text);
+        ++test_failures;
+    }
+}
+
+void check_equal(long long actual, long long expected, const char *text, const char *file, int line) {
+    if (actual != expected) {
+        printf("%s:%d: check failed: %s is %lld, expected %lld\n", file, line, text, actual, expected);
+        ++test_failures;
+    }
+}
+
+const char *test_path(const char *name) {
+    static char path[MAX_PATH];
+    snprintf(path, MAX_PATH, "%s/%s", test_root, name);
+    return path;
+}
+
+const char *test_url(int server, const char *name) {
+    static char url[STRING_SIZE];
+    snprintf(url, STRING_SIZE, "%s/%s", test_servers[server], name);
+    return url;
+}
+
+BOOL read_test_data(const char *name, memory *mem) {
+    memset(mem, 0, sizeof(memory));
+
+    char path[MAX_PATH];
+    snprintf(path, MAX_PATH, "%s/%s", TEST_DATA_DIR, name);
+    FILE *file_in = fopen(path, "rb");
+    if (!file_in) return FALSE;
+
+    BOOL result = TRUE;
+    char buffer[BUFFER_SIZE];
+    size_t nbytes;
+    while (result && (nbytes = fread(buffer, 1, BUFFER_SIZE, file_in)) != 0) {
+        char *data = (char *) realloc(mem->data, mem->size + nbytes);
+        if (!data) {
+            result = FALSE;
+            break;
+        }
+        memcpy(data + mem->size, buffer, nbytes);
+        mem->data = data;
+        mem->size += nbytes;
+        mem->capacity = mem->size;
+    }
+    fclose(file_in);
+    return result && mem->size != 0;
+}
+
+char *make_test_data(size_t size, unsigned int seed) {
+    char *data = (char *) malloc(max(size, 1));
+    unsigned int state = seed * 2654435761u + 1;
+    for (size_t i=0; i<size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[i] = (char) state;
+    }
+    return data;
+}
+
+BOOL write_test_file(const char *name, const char *data, size_t size) {
+    FILE *file_out = fopen(test_path(name), "wb");
+    if (!file_out) return FALSE;
+
+    BOOL result = fwrite(data, 1, size, file_out) == size;
+    return fclose(file_out) == 0 && result;
+}
+
+BOOL file_has_data(const char *path, const char *data, size_t size) {
+    FILE *file_in = fopen(path, "rb");
+    if (!file_in) return FALSE;
+
+    char *buffer = (char *) malloc(size + 1);
+    size_t nbytes = buffer ? fread(buffer, 1, size + 1, file_in) : 0;
+    fclose(file_in);
+
+    BOOL result = buffer && nbytes == size && memcmp(buffer, data, size) == 0;
+    free(buffer);
+    return result;
+}
+
+void sha256_hex(const char *data, size_t size, char *hex) {
+    sha256_context ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, size);
+    sha256_final_hex(&ctx, hex);
+}
+
+BOOL standin_control(int server, const char *query) {
+    char url[STRING_SIZE];
+    snprintf(url, STRING_SIZE, "%s/_control?%s", test_servers[server], query);
+
+    memory mem;
+    if (download_file(&mem, url, download_query_size, NULL, NULL) != error_ok) return FALSE;
+    free(mem.data);
+    return TRUE;
+}
+
+BOOL standin_read_stats(int server, standin_stats *stats) {
+    memset(stats, 0, sizeof(standin_stats));
+
+    char url[STRING_SIZE];
+    snprintf(url, STRING_SIZE, "%s/_stats?reset=1", test_servers[server]);
+
+    memory mem;
+    if (download_file(&mem, url, download_query_size, NULL, NULL) != error_ok) return FALSE;
+
+    json_reader reader;
+    json_reader_init(&reader, mem.data, mem.size);
+    BOOL result = json_next(&reader) == JSON_OBJECT_BEGIN;
+    while (result && json_next_member(&reader)) {
+        size_t value = 0;
+        BOOL is_requests = json_string_equals(&reader, "requests");
+        BOOL is_range_requests = json_string_equals(&reader, "range_requests");
+        BOOL is_bytes = json_string_equals(&reader, "bytes");
+        if (!json_read_size(&reader, &value)) continue;
+        if (is_requests) stats->requests = (long) value;
+        if (is_range_requests) stats->range_requests = (long) value;
+        if (is_bytes) stats->bytes = (long long) value;
+    }
+    free(mem.data);
+    return result;
+}
+
+double elapsed_ms(double start) {
+    return (get_time_seconds() - start) * 1000.0;
+}
+
+typedef struct {
+    const char *name;
+    void (*run)();
+    // benchmarks only run when they are named
+    BOOL is_benchmark;
+} test_group;
+
+static const test_group test_groups[] = {
+    { "download", test_download, FALSE },
+    { "sinks", test_sinks, FALSE },
+    { "bench-sinks", bench_sinks, TRUE },
+    { "json", test_json_reader, FALSE },
+    { "bench-json", bench_json_reader, TRUE },
+    { "mirrors", test_mirrors, FALSE },
+};
+
+#define NUM_TEST_GROUPS (sizeof(test_groups) / sizeof(test_groups[0]))
+
+int main(int argc, char **argv) {
+    test_root = getenv("BANG_TEST_ROOT");
+    const char *servers = getenv("BANG_TEST_SERVERS");
+    if (!test_root || !servers) {
+        fprintf(stderr, "BANG_TEST_ROOT and BANG_TEST_SERVERS are not set, run this through tests/standin_server.py\n");
+        return 1;
+    }
+    while (*servers && num_test_servers < MAX_TEST_SERVERS) {
+        size_t length = strcspn(servers, " ");
+        if (length != 0) {
+            snprintf(test_servers[num_test_servers++], STRING_SIZE, "%.*s", (int) length, servers);
+        }
+        servers += length + (servers[length] == ' ');
+    }
+
+    http_config.timeout_ms = 5000;
+    if (http_session_open(&shared_session, &http_config) != error_ok) {
+        fprintf(stderr, "Could not open http session\n");
+        return 1;
+    }
+
+    BOOL found = FALSE;
+    for (size_t i=0; i<NUM_TEST_GROUPS; ++i) {
+        const test_group *group = &test_groups[i];
+        if (argc > 1 ? strcmp(argv[1], group->name) != 0 : group->is_benchmark) continue;
+
+        printf("%s\n", group->name);
+        for (int j=0; j<num_test_servers; ++j) {
+            standin_control(j, "");
+        }
+        group->run();
+        found = TRUE;
+    }
+    if (!found) {
+        fprintf(stderr, "Unknown test group %s\n", argc > 1 ? argv[1] : "");
+        return 1;
+    }
+
+    http_session_close(&shared_session);
+    printf("%d failed checks\n", test_failures);
+    return min(test_failures, 100);
+}
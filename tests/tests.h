@@ -0,0 +1,63 @@
+#ifndef __TESTS_H__
+#define __TESTS_H__
+
+#include "sys.h"
+
+// the tests run against the stand-in servers started by standin_server.py, which all serve the files of test_root.
+// a failed check is reported and counted, and the test goes on
+
+#define MAX_TEST_SERVERS 4
+
+extern int test_failures;
+
+#define CHECK(condition) check_condition((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) check_equal((long long) (actual), (long long) (expected), #actual, __FILE__, __LINE__)
+
+void check_condition(BOOL condition, const char *text, const char *file, int line);
+void check_equal(long long actual, long long expected, const char *text, const char *file, int line);
+
+extern char test_servers[MAX_TEST_SERVERS][STRING_SIZE];
+extern int num_test_servers;
+extern const char *test_root;
+
+// path of name in the served directory, in a static buffer that the next call overwrites
+const char *test_path(const char *name);
+
+// url of name on one of the servers
+const char *test_url(int server, const char *name);
+
+// reads one of the recorded responses of tests/data
+BOOL read_test_data(const char *name, memory *mem);
+
+// pseudo random bytes that compress poorly, the caller frees them
+char *make_test_data(size_t size, unsigned int seed);
+
+BOOL write_test_file(const char *name, const char *data, size_t size);
+void sha256_hex(const char *data, size_t size, char *hex);
+
+// whether the file at path holds exactly these bytes
+BOOL file_has_data(const char *path, const char *data, size_t size);
+
+// changes the behaviour of a server, see standin_server.py. an empty query resets it
+BOOL standin_control(int server, const char *query);
+
+typedef struct {
+    long requests;
+    long range_requests;
+    long long bytes;
+} standin_stats;
+
+// the requests and bytes served since the previous call
+BOOL standin_read_stats(int server, standin_stats *stats);
+
+// milliseconds between two calls of get_time_seconds, for the benchmarks
+double elapsed_ms(double start);
+
+void test_download();
+void test_sinks();
+void bench_sinks();
+void test_json_reader();
+void bench_json_reader();
+void test_mirrors();
+
+#endif
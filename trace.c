@@ -0,0 +1,118 @@
+#include <stdatomic.h>
+
+#include "trace.h"
+
+typedef struct {
+    const char *category;
+    char name[TRACE_NAME_SIZE];
+    double start;
+    double end;
+    long long bytes;
+    unsigned long long thread_id;
+    atomic_int ready;
+} trace_event;
+
+static trace_event *trace_events = NULL;
+static atomic_int num_trace_events;
+static double trace_origin;
+static char trace_path[MAX_PATH];
+
+BOOL trace_enable(const char *path) {
+    strncpy(trace_path, path, MAX_PATH - 1);
+    if (trace_events) {
+        return TRUE;
+    }
+    trace_events = (trace_event *) calloc(MAX_TRACE_EVENTS, sizeof(trace_event));
+    if (!trace_events) {
+        return FALSE;
+    }
+    atomic_store(&num_trace_events, 0);
+    trace_origin = get_time_seconds();
+    return TRUE;
+}
+
+void trace_disable() {
+    free(trace_events);
+    trace_events = NULL;
+}
+
+BOOL trace_enabled() {
+    return trace_events != NULL;
+}
+
+double trace_begin() {
+    return trace_events ? get_time_seconds() : 0.0;
+}
+
+void trace_end(const char *category, const char *name, double start, long long bytes) {
+    if (trace_events) {
+        trace_span(category, name, start, get_time_seconds(), bytes);
+    }
+}
+
+void trace_span(const char *category, const char *name, double start, double end, long long bytes) {
+    if (!trace_events) {
+        return;
+    }
+
+    // slots are reserved without a lock, ready tells the writer that the slot is filled in
+    int index = atomic_fetch_add(&num_trace_events, 1);
+    if (index >= MAX_TRACE_EVENTS) {
+        return;
+    }
+    trace_event *event = &trace_events[index];
+    event->category = category;
+    strncpy(event->name, name, TRACE_NAME_SIZE - 1);
+    event->start = start;
+    event->end = end;
+    event->bytes = bytes;
+    event->thread_id = get_thread_id();
+    atomic_store(&event->ready, TRUE);
+}
+
+static void write_json_string(FILE *file_out, const char *str) {
+    fputc('"', file_out);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', file_out);
+            fputc(*str, file_out);
+        } else if ((unsigned char) *str >= 0x20) {
+            fputc(*str, file_out);
+        }
+    }
+    fputc('"', file_out);
+}
+
+void trace_write() {
+    if (!trace_events) {
+        return;
+    }
+
+    FILE *file_out = fopen(trace_path, "w");
+    if (!file_out) {
+        return;
+    }
+
+    int num_events = min(atomic_load(&num_trace_events), MAX_TRACE_EVENTS);
+    BOOL first = TRUE;
+    fputs("{\"traceEvents\":[\n", file_out);
+    for (int i=0; i<num_events; ++i) {
+        const trace_event *event = &trace_events[i];
+        if (!atomic_load(&event->ready)) continue;
+
+        fputs(first ? "{\"name\":" : ",\n{\"name\":", file_out);
+        first = FALSE;
+        write_json_string(file_out, event->name);
+        fputs(",\"cat\":", file_out);
+        write_json_string(file_out, event->category);
+        // timestamps are in microseconds
+        fprintf(file_out, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu",
+            (event->start - trace_origin) * 1e6, (event->end - event->start) * 1e6, event->thread_id);
+        if (event->bytes >= 0) {
+            fprintf(file_out, ",\"args\":{\"bytes\":%lld}", event->bytes);
+        }
+        fputc('}', file_out);
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file_out);
+    fclose(file_out);
+}
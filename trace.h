@@ -0,0 +1,29 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "sys.h"
+
+// spans are kept in memory and written in the chrome trace format, which chrome://tracing and perfetto can open.
+// tracing is off unless trace_enable is called, until then every function returns right away
+
+#define MAX_TRACE_EVENTS 32768
+#define TRACE_NAME_SIZE 128
+
+// the trace is written to path by trace_write, events past MAX_TRACE_EVENTS are dropped.
+// if tracing is already enabled only the path is changed
+BOOL trace_enable(const char *path);
+void trace_disable();
+
+BOOL trace_enabled();
+
+// returns the start time of a span, to be passed to trace_end
+double trace_begin();
+
+// bytes is shown in the arguments of the span, unless it is negative
+void trace_end(const char *category, const char *name, double start, long long bytes);
+void trace_span(const char *category, const char *name, double start, double end, long long bytes);
+
+// rewrites the whole file with the events recorded so far, it can be called more than once
+void trace_write();
+
+#endif
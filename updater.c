@@ -0,0 +1,2468 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <cjson/cJSON.h>
+#include <zip.h>
+#include <zlib.h>
+#ifdef BANG_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "updater.h"
+#include "download.h"
+#include "chunks.h"
+#include "json_reader.h"
+#include "remote_zip.h"
+#include "trace.h"
+
+#ifndef BANG_SDL_REPO_NAME
+#error "Must specify BANG_SDL_REPO_NAME"
+#else
+#define GITHUB_RELEASE_ENDPOINT "/repos/" BANG_SDL_REPO_NAME "/releases/latest"
+#define GITHUB_COMMIT_ENDPOINT "/repos/" BANG_SDL_REPO_NAME "/git/trees/%s"
+#endif
+
+#define MAX_UNZIP_WORKERS 16
+
+release_information bang_zip_information;
+
+const char *bang_base_dir;
+
+int release_check_ttl = 0;
+
+char api_base_url[STRING_SIZE] = DEFAULT_API_BASE_URL;
+
+double stage_rate_limit = STAGE_RATE_LIMIT;
+
+// extracted files go to the install directory, or to the staged tree while stage_latest_version prepares an update
+const char *staged_files_dir = NULL;
+atomic_int stage_cancelled;
+
+updater_callbacks updater_ui;
+
+progress_counter updater_progress[NUM_PROGRESS_CHANNELS];
+
+install_stats last_install_stats;
+
+verify_stats last_verify_stats;
+
+// bytes written by the extraction in progress, from all of its workers
+atomic_ullong install_bytes_written;
+double install_write_start;
+
+int updater_init() {
+    const char *env_value;
+    if ((env_value = getenv("BANG_DOWNLOAD_SEGMENTS"))) {
+        download_segments = atoi(env_value);
+    }
+    if ((env_value = getenv("BANG_RELEASE_CHECK_TTL"))) {
+        release_check_ttl = atoi(env_value);
+    }
+    if ((env_value = getenv("BANG_HTTP_USER_AGENT"))) {
+        strncpy(http_config.user_agent, env_value, STRING_SIZE - 1);
+    }
+    if ((env_value = getenv("BANG_HTTP_PROXY"))) {
+        strncpy(http_config.proxy, env_value, STRING_SIZE - 1);
+    }
+    if ((env_value = getenv("BANG_HTTP_TIMEOUT"))) {
+        http_config.timeout_ms = atoi(env_value);
+    }
+    if ((env_value = getenv("BANG_API_BASE_URL"))) {
+        strncpy(api_base_url, env_value, STRING_SIZE - 1);
+    }
+    if ((env_value = getenv("BANG_STAGE_RATE_LIMIT"))) {
+        stage_rate_limit = atof(env_value);
+    }
+    if ((env_value = getenv("BANG_MIRRORS"))) {
+        // base urls separated by ';' or ','
+        char mirrors[STRING_SIZE * MAX_MIRRORS];
+        strncpy(mirrors, env_value, sizeof(mirrors) - 1);
+        mirrors[sizeof(mirrors) - 1] = '\0';
+        for (char *mirror = strtok(mirrors, ";,"); mirror; mirror = strtok(NULL, ";,")) {
+            add_download_mirror(mirror);
+        }
+    }
+    if ((env_value = getenv("BANG_TRACE")) && *env_value) {
+        trace_enable(env_value);
+    }
+
+    memset(&bang_zip_information, 0, sizeof(bang_zip_information));
+    bang_base_dir = get_bang_bin_path();
+
+    return http_session_open(&shared_session, &http_config);
+}
+
+void updater_cleanup() {
+    http_session_close(&shared_session);
+    trace_write();
+}
+
+void copy_json_string(char *dest, cJSON *json, const char *name) {
+    cJSON *json_value = cJSON_GetObjectItemCaseSensitive(json, name);
+    if (json_value && cJSON_IsString(json_value)) {
+        strncpy(dest, cJSON_GetStringValue(json_value), STRING_SIZE - 1);
+    }
+}
+
+size_t get_json_size(cJSON *json, const char *name) {
+    cJSON *json_value = cJSON_GetObjectItemCaseSensitive(json, name);
+    return json_value && cJSON_IsNumber(json_value) ? (size_t) cJSON_GetNumberValue(json_value) : 0;
+}
+
+// the whole file is read in a single allocation, mem->data is freed by the caller
+BOOL read_file_to_memory(const char *path, memory *mem) {
+    memset(mem, 0, sizeof(memory));
+
+    FILE *file_in = fopen(path, "rb");
+    if (!file_in) return FALSE;
+
+    size_t size = get_file_size(path);
+    mem->data = (char *) malloc(max(size, (size_t) 1));
+    mem->capacity = size;
+    mem->size = mem->data ? fread(mem->data, 1, size, file_in) : 0;
+    fclose(file_in);
+
+    if (mem->size != size) {
+        free(mem->data);
+        mem->data = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+cJSON *read_json_file(const char *path) {
+    memory mem;
+    if (!read_file_to_memory(path, &mem)) return NULL;
+
+    cJSON *json = cJSON_ParseWithLength(mem.data, mem.size);
+    free(mem.data);
+    return json;
+}
+
+BOOL read_version_manifest(const char *path, installed_version *version) {
+    memset(version, 0, sizeof(installed_version));
+
+    cJSON *json = read_json_file(path);
+    if (!json) return FALSE;
+
+    copy_json_string(version->client_commit, json, "client_commit");
+    copy_json_string(version->cards_commit, json, "cards_commit");
+    copy_json_string(version->cards_sha256, json, "cards_sha256");
+    cJSON_Delete(json);
+
+    return *version->client_commit != '\0';
+}
+
+cJSON *read_manifest_item(const char *path, const char *name) {
+    cJSON *json = read_json_file(path);
+    if (!json) return NULL;
+
+    cJSON *item = cJSON_DetachItemFromObjectCaseSensitive(json, name);
+    cJSON_Delete(json);
+    return item;
+}
+
+// returns the list of installed files recorded in the manifest, or NULL if it has none
+cJSON *read_manifest_files(const char *path) {
+    cJSON *files = read_manifest_item(path, "files");
+    if (files && !cJSON_IsArray(files)) {
+        cJSON_Delete(files);
+        return NULL;
+    }
+    return files;
+}
+
+// returns the crcs recorded in the marker of a staged update, or NULL if it has none
+cJSON *read_manifest_crcs(const char *path) {
+    cJSON *crcs = read_manifest_item(path, "crcs");
+    if (crcs && !cJSON_IsObject(crcs)) {
+        cJSON_Delete(crcs);
+        return NULL;
+    }
+    return crcs;
+}
+
+// files is the list of installed files and is owned by the manifest, it can be NULL.
+// base_commit and crcs are only set for the marker of a staged update: the install that its files were prepared against,
+// and the crcs of the extracted files for the index
+void write_version_manifest(const char *path, const installed_version *version, const char *base_commit, cJSON *files, cJSON *crcs) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "client_commit", version->client_commit);
+    cJSON_AddStringToObject(json, "cards_commit", version->cards_commit);
+    cJSON_AddStringToObject(json, "cards_sha256", version->cards_sha256);
+    if (base_commit) {
+        cJSON_AddStringToObject(json, "base_commit", base_commit);
+    }
+    if (files) {
+        cJSON_AddItemToObject(json, "files", files);
+    }
+    if (crcs) {
+        cJSON_AddItemToObject(json, "crcs", crcs);
+    }
+
+    char *str = cJSON_Print(json);
+    cJSON_Delete(json);
+
+    if (str) {
+        FILE *file_out = fopen(path, "wb");
+        if (file_out) {
+            fputs(str, file_out);
+            fclose(file_out);
+        }
+        cJSON_free(str);
+    }
+}
+
+// the version manifest is written at install time, loading the client is only needed for installs that predate it
+BOOL get_installed_version(installed_version *version) {
+    memset(version, 0, sizeof(installed_version));
+
+    char path[MAX_PATH];
+    strncpy(path, concat_path(bang_base_dir, CLIENT_LIBRARY_NAME), MAX_PATH);
+    if (!file_exists(path)) {
+        return FALSE;
+    }
+
+    if (read_version_manifest(concat_path(bang_base_dir, VERSION_MANIFEST), version)) {
+        return TRUE;
+    }
+
+    double start = trace_begin();
+    probe_client_version(bang_base_dir, version->client_commit, version->cards_commit);
+    trace_end("check", "probe_client_version", start, -1);
+    return *version->client_commit != '\0';
+}
+
+BOOL must_download_cards_pak() {
+    double start = trace_begin();
+    BOOL ret = TRUE;
+    if (bang_zip_information.cards_pak_size == 0) {
+        ret = FALSE;
+    } else {
+        installed_version installed;
+        if (get_installed_version(&installed)) {
+            if (strcmp(bang_zip_information.cards_commit, installed.cards_commit) == 0) {
+                ret = FALSE;
+            } else if (*bang_zip_information.cards_pak_sha256 && strcmp(bang_zip_information.cards_pak_sha256, installed.cards_sha256) == 0) {
+                // the cards commit changed but the published asset is identical to the installed one
+                ret = FALSE;
+            }
+        }
+    }
+    trace_end("check", "must_download_cards_pak", start, -1);
+    return ret;
+}
+
+// github publishes the digest of each release asset as "sha256:<hex>", it is missing on older releases
+void copy_asset_sha256(char *dest, const char *digest) {
+    if (strncmp(digest, "sha256:", 7) == 0) {
+        strncpy(dest, digest + 7, SHA256_HEX_SIZE - 1);
+        dest[SHA256_HEX_SIZE - 1] = '\0';
+    } else {
+        *dest = '\0';
+    }
+}
+
+void get_asset_sha256(char *dest, cJSON *asset) {
+    cJSON *json_digest = cJSON_GetObjectItemCaseSensitive(asset, "digest");
+    copy_asset_sha256(dest, json_digest && cJSON_IsString(json_digest) ? cJSON_GetStringValue(json_digest) : "");
+}
+
+// the fields of a release asset that are used, everything else in the asset (such as its uploader) is skipped
+typedef struct {
+    char name[STRING_SIZE];
+    char url[STRING_SIZE];
+    size_t size;
+    char sha256[SHA256_HEX_SIZE];
+} release_asset;
+
+void read_release_asset(json_reader *reader, release_asset *asset) {
+    memset(asset, 0, sizeof(release_asset));
+
+    char digest[STRING_SIZE] = {0};
+    while (json_next_member(reader)) {
+        if (json_string_equals(reader, "name")) {
+            json_read_string(reader, asset->name, STRING_SIZE);
+        } else if (json_string_equals(reader, "browser_download_url")) {
+            json_read_string(reader, asset->url, STRING_SIZE);
+        } else if (json_string_equals(reader, "size")) {
+            json_read_size(reader, &asset->size);
+        } else if (json_string_equals(reader, "digest")) {
+            json_read_string(reader, digest, STRING_SIZE);
+        } else {
+            json_skip_member(reader);
+        }
+    }
+    copy_asset_sha256(asset->sha256, digest);
+}
+
+// a delta applies to installed_commit if its name holds that commit, possibly abbreviated
+BOOL is_delta_asset_for(const release_asset *asset, const char *installed_commit) {
+    size_t prefix_length = strlen(DELTA_ASSET_PREFIX);
+    const char *extension = strrchr(asset->name, '.');
+    if (strncmp(asset->name, DELTA_ASSET_PREFIX, prefix_length) != 0 || !extension || strcmp(extension, DELTA_ASSET_EXTENSION) != 0) {
+        return FALSE;
+    }
+
+    size_t commit_length = extension - asset->name - prefix_length;
+    return commit_length >= MIN_COMMIT_PREFIX && strlen(installed_commit) >= commit_length
+        && strncmp(asset->name + prefix_length, installed_commit, commit_length) == 0;
+}
+
+// the release json is scanned without building it in memory, most of it is the description and the uploader of every asset.
+// the game zip is the first asset and cards.pak the second one, deltas and the chunk index can follow in any order
+int parse_bang_release(const char *data, size_t size, const char *installed_commit) {
+    double start = trace_begin();
+    memset(&bang_zip_information, 0, sizeof(bang_zip_information));
+
+    json_reader reader;
+    json_reader_init(&reader, data, size);
+    if (json_next(&reader) != JSON_OBJECT_BEGIN) {
+        return error_cant_parse_json;
+    }
+
+    release_asset *assets = NULL;
+    int num_assets = 0;
+    BOOL has_version = FALSE;
+    BOOL has_commit = FALSE;
+    BOOL has_assets = FALSE;
+    while (!(has_version && has_commit && has_assets) && json_next_member(&reader)) {
+        if (json_string_equals(&reader, "name")) {
+            has_version = json_read_string(&reader, bang_zip_information.version, STRING_SIZE);
+        } else if (json_string_equals(&reader, "target_commitish")) {
+            has_commit = json_read_string(&reader, bang_zip_information.commit, STRING_SIZE);
+        } else if (json_string_equals(&reader, "assets")) {
+            if (json_next(&reader) != JSON_ARRAY_BEGIN) {
+                json_skip_value(&reader);
+                continue;
+            }
+            while (json_next(&reader) == JSON_OBJECT_BEGIN) {
+                release_asset *new_assets = (release_asset *) realloc(assets, (num_assets + 1) * sizeof(release_asset));
+                if (!new_assets) break;
+                assets = new_assets;
+                read_release_asset(&reader, &assets[num_assets++]);
+            }
+            has_assets = reader.type == JSON_ARRAY_END;
+        } else {
+            json_skip_member(&reader);
+        }
+    }
+
+    int errcode = error_ok;
+    if (!has_version || !has_commit || !has_assets) {
+        errcode = error_cant_parse_json;
+    } else if (num_assets == 0 || !*assets[0].url) {
+        errcode = error_no_release_found;
+    } else {
+        strncpy(bang_zip_information.zip_url, assets[0].url, STRING_SIZE);
+        bang_zip_information.zip_size = assets[0].size;
+        strncpy(bang_zip_information.zip_sha256, assets[0].sha256, SHA256_HEX_SIZE);
+
+        if (num_assets > 1) {
+            strncpy(bang_zip_information.cards_pak_url, assets[1].url, STRING_SIZE);
+            bang_zip_information.cards_pak_size = assets[1].size;
+            strncpy(bang_zip_information.cards_pak_sha256, assets[1].sha256, SHA256_HEX_SIZE);
+        }
+
+        for (int i=2; i<num_assets; ++i) {
+            const release_asset *asset = &assets[i];
+            if (!*bang_zip_information.delta_url && is_delta_asset_for(asset, installed_commit)) {
+                strncpy(bang_zip_information.delta_from_commit, installed_commit, STRING_SIZE - 1);
+                strncpy(bang_zip_information.delta_url, asset->url, STRING_SIZE);
+                bang_zip_information.delta_size = asset->size;
+                strncpy(bang_zip_information.delta_sha256, asset->sha256, SHA256_HEX_SIZE);
+            } else if (strcmp(asset->name, CARDS_INDEX_ASSET) == 0) {
+                strncpy(bang_zip_information.cards_index_url, asset->url, STRING_SIZE);
+            }
+        }
+    }
+    free(assets);
+
+    trace_end("check", "parse_bang_release", start, size);
+    return errcode;
+}
+
+// finds the entry of path in a git tree response and copies one of its fields, the scan stops at the entry
+BOOL find_tree_field(const char *data, size_t size, const char *path, const char *field, char *dest) {
+    double start = trace_begin();
+
+    json_reader reader;
+    json_reader_init(&reader, data, size);
+
+    BOOL found = FALSE;
+    if (json_next(&reader) == JSON_OBJECT_BEGIN) {
+        while (!found && json_next_member(&reader)) {
+            if (!json_string_equals(&reader, "tree")) {
+                json_skip_member(&reader);
+                continue;
+            }
+            if (json_next(&reader) != JSON_ARRAY_BEGIN) break;
+
+            while (!found && json_next(&reader) == JSON_OBJECT_BEGIN) {
+                char item_path[MAX_PATH] = {0};
+                char value[STRING_SIZE] = {0};
+                while (json_next_member(&reader)) {
+                    if (json_string_equals(&reader, "path")) {
+                        json_read_string(&reader, item_path, MAX_PATH);
+                    } else if (json_string_equals(&reader, field)) {
+                        json_read_string(&reader, value, STRING_SIZE);
+                    } else {
+                        json_skip_member(&reader);
+                    }
+                }
+                if (strcmp(item_path, path) == 0 && *value) {
+                    strncpy(dest, value, STRING_SIZE);
+                    found = TRUE;
+                }
+            }
+            break;
+        }
+    }
+
+    trace_end("check", "find_tree_field", start, size);
+    return found;
+}
+
+int get_cards_latest_version() {
+    memory mem;
+    char url[STRING_SIZE];
+
+    snprintf(url, STRING_SIZE, "%s" GITHUB_COMMIT_ENDPOINT, api_base_url, bang_zip_information.commit);
+    int errcode = download_file(&mem, url, download_query_size, NULL, NULL);
+    if (errcode != error_ok) {
+        return errcode;
+    }
+
+    BOOL found = find_tree_field(mem.data, mem.size, "resources", "url", url);
+    free(mem.data);
+    if (!found) {
+        return error_no_release_found;
+    }
+
+    errcode = download_file(&mem, url, download_query_size, NULL, NULL);
+    if (errcode != error_ok) {
+        return errcode;
+    }
+
+    found = find_tree_field(mem.data, mem.size, "cards", "sha", bang_zip_information.cards_commit);
+    free(mem.data);
+    return found ? error_ok : error_no_release_found;
+}
+
+typedef struct {
+    release_information info;
+    char etag[STRING_SIZE];
+    time_t timestamp;
+} release_cache;
+
+BOOL read_release_cache(release_cache *cache) {
+    memset(cache, 0, sizeof(release_cache));
+
+    cJSON *json = read_json_file(concat_path(bang_base_dir, "release_cache.json"));
+    if (!json) return FALSE;
+
+    copy_json_string(cache->etag, json, "etag");
+    cache->timestamp = (time_t) get_json_size(json, "timestamp");
+
+    copy_json_string(cache->info.version, json, "version");
+    copy_json_string(cache->info.commit, json, "commit");
+    copy_json_string(cache->info.zip_url, json, "zip_url");
+    cache->info.zip_size = get_json_size(json, "zip_size");
+    get_asset_sha256(cache->info.zip_sha256, cJSON_GetObjectItemCaseSensitive(json, "zip"));
+    copy_json_string(cache->info.cards_commit, json, "cards_commit");
+    copy_json_string(cache->info.cards_pak_url, json, "cards_pak_url");
+    cache->info.cards_pak_size = get_json_size(json, "cards_pak_size");
+    get_asset_sha256(cache->info.cards_pak_sha256, cJSON_GetObjectItemCaseSensitive(json, "cards_pak"));
+    copy_json_string(cache->info.cards_index_url, json, "cards_index_url");
+    copy_json_string(cache->info.delta_from_commit, json, "delta_from_commit");
+    copy_json_string(cache->info.delta_url, json, "delta_url");
+    cache->info.delta_size = get_json_size(json, "delta_size");
+    get_asset_sha256(cache->info.delta_sha256, cJSON_GetObjectItemCaseSensitive(json, "delta"));
+
+    cJSON_Delete(json);
+    return *cache->info.commit && *cache->info.zip_url;
+}
+
+// digests are cached in the same form as in the release json
+void add_asset_sha256(cJSON *json, const char *name, const char *sha256) {
+    if (*sha256) {
+        char buffer[STRING_SIZE];
+        snprintf(buffer, STRING_SIZE, "sha256:%s", sha256);
+
+        cJSON *json_asset = cJSON_CreateObject();
+        cJSON_AddStringToObject(json_asset, "digest", buffer);
+        cJSON_AddItemToObject(json, name, json_asset);
+    }
+}
+
+void write_release_cache(const release_cache *cache) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "etag", cache->etag);
+    cJSON_AddNumberToObject(json, "timestamp", (double) cache->timestamp);
+
+    cJSON_AddStringToObject(json, "version", cache->info.version);
+    cJSON_AddStringToObject(json, "commit", cache->info.commit);
+    cJSON_AddStringToObject(json, "zip_url", cache->info.zip_url);
+    cJSON_AddNumberToObject(json, "zip_size", (double) cache->info.zip_size);
+    add_asset_sha256(json, "zip", cache->info.zip_sha256);
+    cJSON_AddStringToObject(json, "cards_commit", cache->info.cards_commit);
+    cJSON_AddStringToObject(json, "cards_pak_url", cache->info.cards_pak_url);
+    cJSON_AddNumberToObject(json, "cards_pak_size", (double) cache->info.cards_pak_size);
+    add_asset_sha256(json, "cards_pak", cache->info.cards_pak_sha256);
+    if (*cache->info.cards_index_url) {
+        cJSON_AddStringToObject(json, "cards_index_url", cache->info.cards_index_url);
+    }
+    if (*cache->info.delta_url) {
+        cJSON_AddStringToObject(json, "delta_from_commit", cache->info.delta_from_commit);
+        cJSON_AddStringToObject(json, "delta_url", cache->info.delta_url);
+        cJSON_AddNumberToObject(json, "delta_size", (double) cache->info.delta_size);
+        add_asset_sha256(json, "delta", cache->info.delta_sha256);
+    }
+
+    char *str = cJSON_Print(json);
+    cJSON_Delete(json);
+
+    if (str) {
+        if (!file_exists(bang_base_dir)) {
+            make_dir(bang_base_dir);
+        }
+        FILE *file_out = fopen(concat_path(bang_base_dir, "release_cache.json"), "wb");
+        if (file_out) {
+            fputs(str, file_out);
+            fclose(file_out);
+        }
+        cJSON_free(str);
+    }
+}
+
+int get_bang_latest_version() {
+    release_cache cache;
+    BOOL has_cache = read_release_cache(&cache);
+
+    time_t now = time(NULL);
+    if (has_cache && release_check_ttl > 0 && now - cache.timestamp < release_check_ttl) {
+        bang_zip_information = cache.info;
+        return error_ok;
+    }
+
+    memory mem;
+    char etag[STRING_SIZE] = {0};
+    char url[STRING_SIZE];
+    snprintf(url, STRING_SIZE, "%s" GITHUB_RELEASE_ENDPOINT, api_base_url);
+
+    int errcode = download_file_conditional(&mem, url, has_cache ? cache.etag : NULL, etag);
+    if (errcode == error_not_modified) {
+        // a 304 response does not count against the rate limit and carries no body to parse
+        bang_zip_information = cache.info;
+        cache.timestamp = now;
+        write_release_cache(&cache);
+        return error_ok;
+    }
+    if (errcode == error_ok) {
+        // only an install with a manifest can be patched, since the delta must know what it replaces
+        installed_version installed;
+        read_version_manifest(concat_path(bang_base_dir, VERSION_MANIFEST), &installed);
+        errcode = parse_bang_release(mem.data, mem.size, installed.client_commit);
+        free(mem.data);
+    }
+
+    if (errcode == error_ok) {
+        // git trees are addressed by their hash, so the cards commit only changes along with the release commit
+        if (has_cache && *cache.info.cards_commit && strcmp(cache.info.commit, bang_zip_information.commit) == 0) {
+            strncpy(bang_zip_information.cards_commit, cache.info.cards_commit, STRING_SIZE);
+        } else {
+            errcode = get_cards_latest_version();
+        }
+    }
+
+    if (errcode == error_ok) {
+        cache.info = bang_zip_information;
+        strncpy(cache.etag, etag, STRING_SIZE);
+        cache.timestamp = now;
+        write_release_cache(&cache);
+    }
+
+    return errcode;
+}
+
+int must_download_latest_version(int *result) {
+    double start = trace_begin();
+    int errcode = get_bang_latest_version();
+    *result = TRUE;
+    installed_version installed;
+    if (get_installed_version(&installed)) {
+        if (errcode == error_cant_access_site) {
+            printf("Starting latest installed version\n");
+            errcode = error_ok;
+            *result = FALSE;
+        } else if (errcode == error_ok && strcmp(bang_zip_information.commit, installed.client_commit) == 0) {
+            *result = FALSE;
+        }
+    }
+    trace_end("check", "must_download_latest_version", start, -1);
+    return errcode;
+}
+
+void set_status(const char *format, ...) {
+    va_list arg;
+    char buffer[256];
+
+    va_start(arg, format);
+    vsnprintf(buffer, 256, format, arg);
+    va_end(arg);
+
+    if (updater_ui.status) {
+        updater_ui.status(buffer);
+    }
+}
+
+void progress_start(progress_counter *counter, unsigned long long bytes_total) {
+    atomic_store(&counter->bytes_done, 0);
+    atomic_store(&counter->bytes_total, bytes_total);
+    atomic_fetch_add(&counter->phase, 1);
+}
+
+// parallel workers can report out of order, the counter only moves forward
+void progress_advance(progress_counter *counter, unsigned long long bytes_done) {
+    unsigned long long current = atomic_load(&counter->bytes_done);
+    while (current < bytes_done && !atomic_compare_exchange_weak(&counter->bytes_done, &current, bytes_done));
+}
+
+void publish_download_progress(int bytes_read, int bytes_total, void *params) {
+    progress_advance((progress_counter *) params, bytes_read);
+}
+
+BOOL compute_file_crc(const char *path, char *buffer, size_t buffer_size, unsigned int *crc) {
+    FILE *file_in = fopen(path, "rb");
+    if (!file_in) return FALSE;
+
+    uLong file_crc = crc32(0L, Z_NULL, 0);
+    size_t nbytes;
+    while ((nbytes = fread(buffer, 1, buffer_size, file_in)) > 0) {
+        file_crc = crc32(file_crc, (const Bytef *) buffer, nbytes);
+    }
+    BOOL result = !ferror(file_in);
+    fclose(file_in);
+
+    *crc = (unsigned int) file_crc;
+    return result;
+}
+
+// buffer holds MAX_READ_SIZE bytes
+BOOL file_matches_crc(const char *path, zip_uint64_t size, zip_uint32_t crc, char *buffer) {
+    if (get_file_size(path) != size) return FALSE;
+
+    unsigned int file_crc;
+    return compute_file_crc(path, buffer, MAX_READ_SIZE, &file_crc) && file_crc == crc;
+}
+
+// the installed files that were compared with an entry of the release zip when only the changed entries are fetched,
+// so that the extraction skips or writes them without hashing them a second time
+#define ENTRY_UNCHECKED 0
+#define ENTRY_UNCHANGED 1
+#define ENTRY_CHANGED   2
+
+typedef struct {
+    char *path;
+    zip_uint64_t size;
+    zip_uint32_t crc;
+    int status;
+} checked_entry;
+
+typedef struct {
+    checked_entry *entries;
+    long num_entries;
+    long capacity;
+    BOOL sorted;
+} checked_entry_list;
+
+checked_entry_list checked_entries;
+
+void clear_checked_entries() {
+    for (long i=0; i<checked_entries.num_entries; ++i) {
+        free(checked_entries.entries[i].path);
+    }
+    free(checked_entries.entries);
+    memset(&checked_entries, 0, sizeof(checked_entries));
+}
+
+int compare_checked_entries(const void *lhs, const void *rhs) {
+    return strcmp(((const checked_entry *) lhs)->path, ((const checked_entry *) rhs)->path);
+}
+
+int check_installed_file(const char *path, zip_uint64_t size, zip_uint32_t crc, char *buffer) {
+    int status = file_matches_crc(path, size, crc, buffer) ? ENTRY_UNCHANGED : ENTRY_CHANGED;
+
+    if (checked_entries.num_entries == checked_entries.capacity) {
+        long capacity = max(checked_entries.capacity * 2, 256);
+        checked_entry *entries = (checked_entry *) realloc(checked_entries.entries, capacity * sizeof(checked_entry));
+        if (!entries) return status;
+        checked_entries.entries = entries;
+        checked_entries.capacity = capacity;
+    }
+    checked_entry *entry = &checked_entries.entries[checked_entries.num_entries];
+    entry->path = strdup(path);
+    if (!entry->path) return status;
+    entry->size = size;
+    entry->crc = crc;
+    entry->status = status;
+    ++checked_entries.num_entries;
+    checked_entries.sorted = FALSE;
+    return status;
+}
+
+// only called before the workers start, the list is sorted on the first lookup
+int find_checked_entry(const char *path, zip_uint64_t size, zip_uint32_t crc) {
+    if (checked_entries.num_entries == 0) return ENTRY_UNCHECKED;
+    if (!checked_entries.sorted) {
+        qsort(checked_entries.entries, checked_entries.num_entries, sizeof(checked_entry), compare_checked_entries);
+        checked_entries.sorted = TRUE;
+    }
+
+    checked_entry key;
+    key.path = (char *) path;
+    const checked_entry *found = (const checked_entry *) bsearch(&key, checked_entries.entries, checked_entries.num_entries, sizeof(checked_entry), compare_checked_entries);
+    return found && found->size == size && found->crc == crc ? found->status : ENTRY_UNCHECKED;
+}
+
+// extracted files are written in MAX_READ_SIZE blocks from a buffer owned by the caller, bypassing the stdio buffer,
+// and files larger than a block are preallocated first. the data is read or decoded straight into the block
+typedef struct {
+    FILE *file_out;
+    char *buffer;
+    size_t buffered;
+} output_writer;
+
+BOOL output_writer_open(output_writer *writer, const char *path, unsigned long long size, char *buffer) {
+    writer->buffer = buffer;
+    writer->buffered = 0;
+    writer->file_out = fopen(path, "wb");
+    if (!writer->file_out) return FALSE;
+
+    setvbuf(writer->file_out, NULL, _IONBF, 0);
+    if (size > MAX_READ_SIZE) {
+        preallocate_file(writer->file_out, (size_t) size);
+    }
+    return TRUE;
+}
+
+BOOL output_writer_flush(output_writer *writer) {
+    if (writer->buffered == 0) return TRUE;
+
+    BOOL result = fwrite(writer->buffer, writer->buffered, 1, writer->file_out) == 1;
+    atomic_fetch_add(&install_bytes_written, writer->buffered);
+    writer->buffered = 0;
+    return result;
+}
+
+// the free part of the current block
+char *output_writer_reserve(output_writer *writer, size_t *size) {
+    *size = MAX_READ_SIZE - writer->buffered;
+    return writer->buffer + writer->buffered;
+}
+
+BOOL output_writer_commit(output_writer *writer, size_t nbytes) {
+    writer->buffered += nbytes;
+    return writer->buffered < MAX_READ_SIZE || output_writer_flush(writer);
+}
+
+BOOL output_writer_write(output_writer *writer, const char *data, size_t nbytes) {
+    while (nbytes != 0) {
+        size_t size;
+        char *dest = output_writer_reserve(writer, &size);
+        size = min(size, nbytes);
+        memcpy(dest, data, size);
+        if (!output_writer_commit(writer, size)) return FALSE;
+        data += size;
+        nbytes -= size;
+    }
+    return TRUE;
+}
+
+BOOL output_writer_close(output_writer *writer) {
+    BOOL result = output_writer_flush(writer);
+    if (fclose(writer->file_out) != 0) {
+        result = FALSE;
+    }
+    writer->file_out = NULL;
+    return result;
+}
+
+BOOL is_staging_cancelled() {
+    return staged_files_dir && atomic_load(&stage_cancelled);
+}
+
+const char *get_output_dir() {
+    return staged_files_dir ? staged_files_dir : bang_base_dir;
+}
+
+// the parents are created from the base directory down, a path can mix both separators
+void make_parent_dirs(const char *path, size_t base_dir_length) {
+    char dir[MAX_PATH];
+    for (size_t i=base_dir_length + 1; i < MAX_PATH && path[i]; ++i) {
+        if (path[i] == '/' || path[i] == '\\') {
+            memcpy(dir, path, i);
+            dir[i] = '\0';
+            make_dir(dir);
+        }
+    }
+}
+
+void start_install_writes() {
+    atomic_store(&install_bytes_written, 0);
+    install_write_start = get_time_seconds();
+}
+
+// the write rate is shown next to each file, slow disks and on-access scanners are what usually holds an install back
+void set_install_status(const char *action, const char *path) {
+    double elapsed = get_time_seconds() - install_write_start;
+    unsigned long long bytes_written = atomic_load(&install_bytes_written);
+    if (elapsed > 0 && bytes_written != 0) {
+        set_status("%s: %s (%.1f MB/s)", action, path, bytes_written / elapsed / (1024.0 * 1024.0));
+    } else {
+        set_status("%s: %s", action, path);
+    }
+}
+
+typedef struct {
+    zip_uint64_t index;
+    zip_uint64_t size;
+    zip_uint32_t crc;
+    BOOL has_crc;
+    // whether the installed file was already compared with the entry
+    int status;
+    char path[MAX_PATH];
+    // where the entry is extracted, path unless an update is being staged
+    char output_path[MAX_PATH];
+} unzip_entry;
+
+typedef struct {
+    const char *zip_path;
+    size_t base_dir_length;
+    unzip_entry *entries;
+    long num_entries;
+    zip_uint64_t bytes_total;
+
+    atomic_long next_entry;
+    atomic_int failed;
+    atomic_long skipped_entries;
+    atomic_ullong skipped_bytes;
+    atomic_ullong bytes_done;
+} unzip_job;
+
+int compare_unzip_entries(const void *lhs, const void *rhs) {
+    zip_uint64_t lhs_size = ((const unzip_entry *) lhs)->size;
+    zip_uint64_t rhs_size = ((const unzip_entry *) rhs)->size;
+    return (lhs_size < rhs_size) - (lhs_size > rhs_size);
+}
+
+// libzip only compares the crc on the read that reaches the end of the entry, which never happens when exactly
+// size bytes are read, so the crc of the written data is computed here. the entries of a zip fetched by range
+// have no other check
+int unzip_entry_to_file(zip_t *archive, const unzip_entry *entry, char *buffer) {
+    output_writer writer;
+    if (!output_writer_open(&writer, entry->output_path, entry->size, buffer)) return 1;
+
+    int result = 0;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    zip_file_t *file_in = zip_fopen_index(archive, entry->index, 0);
+    if (file_in) {
+        zip_uint64_t remaining_bytes = entry->size;
+        while (remaining_bytes != 0) {
+            size_t size;
+            char *dest = output_writer_reserve(&writer, &size);
+            zip_int64_t nbytes = zip_fread(file_in, dest, (zip_uint64_t) min((zip_uint64_t) size, remaining_bytes));
+            if (nbytes <= 0) {
+                result = 1;
+                break;
+            }
+            crc = crc32(crc, (const Bytef *) dest, (uInt) nbytes);
+            if (!output_writer_commit(&writer, nbytes)) {
+                result = 1;
+                break;
+            }
+            remaining_bytes -= nbytes;
+        }
+        zip_fclose(file_in);
+    } else {
+        result = 1;
+    }
+    if (result == 0 && entry->has_crc && (zip_uint32_t) crc != entry->crc) {
+        result = 1;
+    }
+
+    if (!output_writer_close(&writer)) {
+        result = 1;
+    }
+    if (result != 0) {
+        remove_file(entry->output_path);
+    }
+    return result;
+}
+
+// each worker has its own handle to the archive and takes the next entry from the shared list until it is empty
+int unzip_worker(void *param) {
+    unzip_job *job = (unzip_job *) param;
+
+    int error;
+    zip_t *archive = zip_open(job->zip_path, ZIP_RDONLY, &error);
+    char *buffer = (char *) malloc(MAX_READ_SIZE);
+    if (!archive || !buffer) {
+        atomic_store(&job->failed, TRUE);
+        if (archive) {
+            zip_discard(archive);
+        }
+        free(buffer);
+        return 1;
+    }
+
+    long i;
+    while (!atomic_load(&job->failed) && (i = atomic_fetch_add(&job->next_entry, 1)) < job->num_entries) {
+        const unzip_entry *entry = &job->entries[i];
+        double start = trace_begin();
+        if (is_staging_cancelled()) {
+            atomic_store(&job->failed, TRUE);
+            break;
+        }
+
+        // files that did not change between releases are left untouched
+        if (entry->status == ENTRY_UNCHANGED
+            || (entry->status == ENTRY_UNCHECKED && entry->has_crc && file_matches_crc(entry->path, entry->size, entry->crc, buffer))) {
+            atomic_fetch_add(&job->skipped_entries, 1);
+            atomic_fetch_add(&job->skipped_bytes, entry->size);
+            trace_end("unzip skipped", entry->path + job->base_dir_length, start, entry->size);
+        } else {
+            set_install_status("Install", entry->path);
+            if (unzip_entry_to_file(archive, entry, buffer) != 0) {
+                atomic_store(&job->failed, TRUE);
+                break;
+            }
+            trace_end("unzip", entry->path + job->base_dir_length, start, entry->size);
+        }
+
+        zip_uint64_t bytes_done = atomic_fetch_add(&job->bytes_done, entry->size) + entry->size;
+        progress_advance(&updater_progress[PROGRESS_CLIENT], bytes_done);
+    }
+
+    zip_discard(archive);
+    free(buffer);
+    return 0;
+}
+
+// the relative paths of the extracted files are added to files, if it is not NULL, and their crc to crcs
+// under the same path, if it is not NULL. if filter is not NULL, only the entries that it accepts are extracted
+int unzip_bang_entries(const char *zip_path, cJSON *files, cJSON *crcs, zip_entry_filter filter, void *filter_params) {
+    double start_time = get_time_seconds();
+
+    int error;
+    zip_t *archive = zip_open(zip_path, ZIP_RDONLY, &error);
+    if (!archive) {
+        return 1;
+    }
+
+    if (!file_exists(bang_base_dir)) {
+        make_dir(bang_base_dir);
+    }
+
+    unzip_job job;
+    memset(&job, 0, sizeof(job));
+    job.zip_path = zip_path;
+    job.base_dir_length = strlen(bang_base_dir) + 1;
+
+    zip_int64_t num_entries = zip_get_num_entries(archive, 0);
+    job.entries = (unzip_entry *) malloc(sizeof(unzip_entry) * (num_entries > 0 ? num_entries : 1));
+    if (!job.entries) {
+        zip_discard(archive);
+        return 1;
+    }
+
+    for (zip_int64_t i=0; i<num_entries; ++i) {
+        const char *name = zip_get_name(archive, i, 0);
+        const char *slash_pos = name ? strchr(name, '/') : NULL;
+        if (!slash_pos) continue;
+
+        if (name[strlen(name) - 1] == '/') {
+            // directories are created upfront so that workers can extract their files in any order
+            make_dir(concat_path(get_output_dir(), slash_pos + 1));
+            continue;
+        }
+        const char *path = concat_path(bang_base_dir, slash_pos + 1);
+        if (is_directory(path)) continue;
+
+        zip_stat_t stat;
+        if (zip_stat_index(archive, i, 0, &stat) != 0) continue;
+        if (filter && !filter(name, stat.size, stat.crc, filter_params)) continue;
+
+        unzip_entry *entry = &job.entries[job.num_entries++];
+        entry->index = i;
+        entry->size = stat.size;
+        entry->crc = stat.crc;
+        entry->has_crc = (stat.valid & ZIP_STAT_CRC) != 0;
+        entry->status = entry->has_crc ? find_checked_entry(path, stat.size, stat.crc) : ENTRY_UNCHECKED;
+        strncpy(entry->path, path, MAX_PATH);
+        strncpy(entry->output_path, concat_path(get_output_dir(), slash_pos + 1), MAX_PATH);
+
+        job.bytes_total += stat.size;
+
+        if (files) {
+            cJSON_AddItemToArray(files, cJSON_CreateString(slash_pos + 1));
+        }
+        // an entry is either extracted and checked against its crc, or skipped because the installed file matches it
+        if (crcs && entry->has_crc) {
+            cJSON_AddNumberToObject(crcs, slash_pos + 1, entry->crc);
+        }
+    }
+    zip_discard(archive);
+
+    // largest entries go first so that no worker is left with a big file at the end
+    qsort(job.entries, job.num_entries, sizeof(unzip_entry), compare_unzip_entries);
+    progress_start(&updater_progress[PROGRESS_CLIENT], job.bytes_total);
+    start_install_writes();
+
+    int num_workers = min(get_num_cpus(), MAX_UNZIP_WORKERS);
+    num_workers = max(min(num_workers, (int) job.num_entries), 1);
+    if (staged_files_dir) {
+        // a staged update is extracted while the game is running, on the background thread alone
+        num_workers = 1;
+    }
+
+    thread_t workers[MAX_UNZIP_WORKERS];
+    int num_threads = 0;
+    for (int i=1; i<num_workers; ++i) {
+        if (thread_create(&workers[num_threads], unzip_worker, &job)) {
+            ++num_threads;
+        }
+    }
+    unzip_worker(&job);
+
+    for (int i=0; i<num_threads; ++i) {
+        thread_join(&workers[i]);
+    }
+    free(job.entries);
+    clear_checked_entries();
+
+    double end_time = get_time_seconds();
+    trace_span("unzip", "unzip_bang_zip", start_time, end_time, job.bytes_total);
+    last_install_stats.unzip_time = end_time - start_time;
+    last_install_stats.unzip_bytes = job.bytes_total;
+    last_install_stats.unzip_skipped_bytes = atomic_load(&job.skipped_bytes);
+    last_install_stats.write_bytes = atomic_load(&install_bytes_written);
+
+    set_status("Install: %ld unchanged files skipped (%llu bytes)", atomic_load(&job.skipped_entries), (unsigned long long) atomic_load(&job.skipped_bytes));
+    return atomic_load(&job.failed) ? 1 : 0;
+}
+
+int unzip_bang_zip(const char *zip_path, cJSON *files, cJSON *crcs) {
+    return unzip_bang_entries(zip_path, files, crcs, NULL, NULL);
+}
+
+#ifdef BANG_HAVE_ZSTD
+
+#define ZSTD_MAGIC "\x28\xb5\x2f\xfd"
+#define TAR_BLOCK_SIZE 512
+
+#define TAR_STATE_HEADER  0
+#define TAR_STATE_DATA    1
+#define TAR_STATE_PADDING 2
+
+// the tar stream is parsed as it comes out of the decompressor, nothing is buffered besides the current header
+// and the block being written
+typedef struct {
+    int state;
+    char header[TAR_BLOCK_SIZE];
+    size_t header_size;
+
+    output_writer writer;
+    char *write_buffer;
+    char *name_out;
+    char long_name[MAX_PATH];
+    unsigned long long remaining_bytes;
+    size_t name_size;
+    size_t padding;
+
+    BOOL finished;
+    BOOL failed;
+    cJSON *files;
+    unsigned long long bytes_total;
+} tar_reader;
+
+// sizes are octal, or big endian base 256 when the high bit of the first byte is set
+unsigned long long parse_tar_number(const char *field, size_t size) {
+    unsigned long long value = 0;
+    if ((unsigned char) field[0] & 0x80) {
+        value = (unsigned char) field[0] & 0x7f;
+        for (size_t i=1; i<size; ++i) {
+            value = (value << 8) | (unsigned char) field[i];
+        }
+        return value;
+    }
+    for (size_t i=0; i<size && field[i]; ++i) {
+        if (field[i] >= '0' && field[i] <= '7') {
+            value = (value << 3) | (field[i] - '0');
+        }
+    }
+    return value;
+}
+
+void tar_read_header(tar_reader *tar) {
+    const char *header = tar->header;
+
+    BOOL empty = TRUE;
+    for (int i=0; i<TAR_BLOCK_SIZE && empty; ++i) {
+        empty = header[i] == '\0';
+    }
+    if (empty) {
+        tar->finished = TRUE;
+        return;
+    }
+
+    char name[MAX_PATH];
+    if (*tar->long_name) {
+        strncpy(name, tar->long_name, MAX_PATH);
+        *tar->long_name = '\0';
+    } else if (memcmp(header + 257, "ustar", 5) == 0 && header[345]) {
+        snprintf(name, MAX_PATH, "%.155s/%.100s", header + 345, header);
+    } else {
+        snprintf(name, MAX_PATH, "%.100s", header);
+    }
+
+    char type = header[156];
+    tar->remaining_bytes = parse_tar_number(header + 124, 12);
+    tar->padding = (TAR_BLOCK_SIZE - tar->remaining_bytes % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    tar->state = TAR_STATE_DATA;
+    tar->writer.file_out = NULL;
+    tar->name_out = NULL;
+
+    if (type == 'L') {
+        // gnu long name, it applies to the next header
+        tar->name_out = tar->long_name;
+        tar->name_size = 0;
+        return;
+    }
+
+    // as in the zip, the top level directory is stripped
+    const char *slash_pos = strchr(name, '/');
+    if (!slash_pos || slash_pos[1] == '\0') return;
+
+    // as in apply_delta, paths must stay inside the install directory
+    const char *entry_path = slash_pos + 1;
+    if (*entry_path == '/' || *entry_path == '\\' || strstr(entry_path, "..")) {
+        tar->failed = TRUE;
+        return;
+    }
+
+    const char *path = concat_path(get_output_dir(), entry_path);
+    if (type == '5') {
+        make_dir(path);
+    } else if ((type == '0' || type == '\0' || type == '7') && !is_directory(path)) {
+        if (!output_writer_open(&tar->writer, path, tar->remaining_bytes, tar->write_buffer)) {
+            tar->writer.file_out = NULL;
+            tar->failed = TRUE;
+            return;
+        }
+        set_install_status("Install", path);
+        if (tar->files) {
+            cJSON_AddItemToArray(tar->files, cJSON_CreateString(entry_path));
+        }
+    }
+    // anything else, such as links and pax headers, is skipped
+}
+
+void tar_finish_entry(tar_reader *tar) {
+    if (tar->writer.file_out && !output_writer_close(&tar->writer)) {
+        tar->failed = TRUE;
+    }
+    if (tar->name_out) {
+        tar->long_name[min(tar->name_size, (size_t) MAX_PATH - 1)] = '\0';
+        tar->name_out = NULL;
+    }
+    tar->state = TAR_STATE_PADDING;
+}
+
+void tar_feed(tar_reader *tar, const char *data, size_t nbytes) {
+    while (nbytes != 0 && !tar->finished && !tar->failed) {
+        size_t chunk_size;
+        switch (tar->state) {
+        case TAR_STATE_HEADER:
+            chunk_size = min(nbytes, TAR_BLOCK_SIZE - tar->header_size);
+            memcpy(tar->header + tar->header_size, data, chunk_size);
+            tar->header_size += chunk_size;
+            if (tar->header_size == TAR_BLOCK_SIZE) {
+                tar->header_size = 0;
+                tar_read_header(tar);
+                if (tar->state == TAR_STATE_DATA && tar->remaining_bytes == 0) {
+                    tar_finish_entry(tar);
+                }
+            }
+            break;
+        case TAR_STATE_DATA:
+            chunk_size = (size_t) min((unsigned long long) nbytes, tar->remaining_bytes);
+            if (tar->writer.file_out && !output_writer_write(&tar->writer, data, chunk_size)) {
+                tar->failed = TRUE;
+            } else if (tar->name_out && tar->name_size < MAX_PATH - 1) {
+                size_t name_bytes = min(chunk_size, MAX_PATH - 1 - tar->name_size);
+                memcpy(tar->name_out + tar->name_size, data, name_bytes);
+                tar->name_size += name_bytes;
+            }
+            tar->remaining_bytes -= chunk_size;
+            if (tar->remaining_bytes == 0) {
+                tar_finish_entry(tar);
+            }
+            break;
+        default:
+            chunk_size = min(nbytes, tar->padding);
+            tar->padding -= chunk_size;
+            if (tar->padding == 0) {
+                tar->state = TAR_STATE_HEADER;
+            }
+            break;
+        }
+        data += chunk_size;
+        nbytes -= chunk_size;
+    }
+}
+
+// zstd frames can only be decoded in order, so unlike the zip this runs on a single thread
+int untar_zst_bang_archive(const char *archive_path, cJSON *files) {
+    double start_time = get_time_seconds();
+
+    FILE *file_in = fopen(archive_path, "rb");
+    if (!file_in) {
+        return 1;
+    }
+
+    if (!file_exists(bang_base_dir)) {
+        make_dir(bang_base_dir);
+    }
+
+    tar_reader tar;
+    memset(&tar, 0, sizeof(tar));
+    tar.files = files;
+    tar.write_buffer = (char *) malloc(MAX_READ_SIZE);
+
+    size_t archive_size = get_file_size(archive_path);
+    progress_start(&updater_progress[PROGRESS_CLIENT], archive_size);
+    start_install_writes();
+
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    size_t in_size = ZSTD_DStreamInSize();
+    size_t out_size = ZSTD_DStreamOutSize();
+    char *in_buffer = (char *) malloc(in_size);
+    char *out_buffer = (char *) malloc(out_size);
+
+    size_t result = 1;
+    unsigned long long bytes_read = 0;
+    if (!stream || !in_buffer || !out_buffer || !tar.write_buffer || ZSTD_isError(ZSTD_initDStream(stream))) {
+        tar.failed = TRUE;
+    }
+    while (!tar.failed && !tar.finished && !is_staging_cancelled()) {
+        size_t nbytes = fread(in_buffer, 1, in_size, file_in);
+        if (nbytes == 0) break;
+
+        ZSTD_inBuffer input = { in_buffer, nbytes, 0 };
+        while (input.pos < input.size && !tar.failed) {
+            ZSTD_outBuffer output = { out_buffer, out_size, 0 };
+            result = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(result)) {
+                tar.failed = TRUE;
+                break;
+            }
+            tar_feed(&tar, out_buffer, output.pos);
+            tar.bytes_total += output.pos;
+        }
+
+        bytes_read += nbytes;
+        progress_advance(&updater_progress[PROGRESS_CLIENT], bytes_read);
+    }
+    // the archive is only complete if the end of the tar was reached
+    if (!tar.finished) {
+        tar.failed = TRUE;
+    }
+
+    if (tar.writer.file_out) {
+        output_writer_close(&tar.writer);
+    }
+    free(tar.write_buffer);
+    free(in_buffer);
+    free(out_buffer);
+    ZSTD_freeDStream(stream);
+    fclose(file_in);
+
+    double end_time = get_time_seconds();
+    trace_span("unzip", "untar_zst_bang_archive", start_time, end_time, tar.bytes_total);
+    last_install_stats.unzip_time = end_time - start_time;
+    last_install_stats.unzip_bytes = tar.bytes_total;
+    last_install_stats.unzip_skipped_bytes = 0;
+    last_install_stats.write_bytes = atomic_load(&install_bytes_written);
+
+    return tar.failed ? 1 : 0;
+}
+
+#endif
+
+// releases are zip archives, or a single .tar.zst stream when the asset is published in that format.
+// the format is told from the content, so that staged and partially downloaded files need no extra metadata.
+// the tar has no crcs, its files are hashed by the index
+int extract_bang_archive(const char *archive_path, cJSON *files, cJSON *crcs) {
+#ifdef BANG_HAVE_ZSTD
+    char magic[4] = {0};
+    FILE *file_in = fopen(archive_path, "rb");
+    if (!file_in) {
+        return 1;
+    }
+    size_t nbytes = fread(magic, 1, sizeof(magic), file_in);
+    fclose(file_in);
+
+    if (nbytes == sizeof(magic) && memcmp(magic, ZSTD_MAGIC, sizeof(magic)) == 0) {
+        return untar_zst_bang_archive(archive_path, files);
+    }
+#endif
+    return unzip_bang_zip(archive_path, files, crcs);
+}
+
+BOOL json_array_has_string(cJSON *array, const char *str) {
+    cJSON *item;
+    cJSON_ArrayForEach(item, array) {
+        if (cJSON_IsString(item) && strcmp(cJSON_GetStringValue(item), str) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+#ifdef BANG_HAVE_ZSTD
+
+// a delta is a zip with a delta.json listing the changed files of the release:
+//   {"from": commit, "to": commit, "files": [{"path": ..., "op": "patch" | "add" | "remove" | "mkdir", "size": ..., "sha256": ...}]}
+// patched files are stored as "patches/<path>.zst", created with zstd --patch-from the installed file,
+// added files are stored as "files/<path>"
+#define DELTA_MANIFEST "delta.json"
+#define DELTA_PATCH_DIR "patches/"
+#define DELTA_PATCH_EXTENSION ".zst"
+#define DELTA_FILE_DIR "files/"
+#define DELTA_MAX_WINDOW_LOG 31
+
+typedef struct {
+    char path[MAX_PATH];
+    char output_path[MAX_PATH];
+    char temp_path[MAX_PATH];
+    BOOL remove;
+} delta_file;
+
+typedef struct {
+    zip_t *archive;
+    ZSTD_DCtx *dctx;
+    char *in_buffer;
+    size_t in_size;
+    char *write_buffer;
+} delta_context;
+
+// the entry is streamed into temp_path, through zstd with base as the dictionary if it is not NULL,
+// and only kept if its size and digest are the ones in the delta manifest
+int write_delta_entry(delta_context *ctx, const char *entry_name, const memory *base, const char *temp_path, size_t size, const char *sha256) {
+    zip_file_t *file_in = zip_fopen(ctx->archive, entry_name, 0);
+    if (!file_in) return 1;
+
+    sha256_context sha;
+    if (!sha256_init(&sha)) {
+        zip_fclose(file_in);
+        return 1;
+    }
+
+    output_writer writer;
+    if (!output_writer_open(&writer, temp_path, size, ctx->write_buffer)) {
+        sha256_free(&sha);
+        zip_fclose(file_in);
+        return 1;
+    }
+
+    if (base) {
+        // a prefix only applies to the next frame, so it is referenced again for every file
+        ZSTD_DCtx_reset(ctx->dctx, ZSTD_reset_session_only);
+        ZSTD_DCtx_refPrefix(ctx->dctx, base->data, base->size);
+    }
+
+    int result = 0;
+    size_t frame_remaining = 0;
+    size_t bytes_written = 0;
+    zip_int64_t nbytes = 0;
+    while (result == 0 && !base) {
+        // added files are read straight into the block being written
+        size_t block_size;
+        char *dest = output_writer_reserve(&writer, &block_size);
+        nbytes = zip_fread(file_in, dest, block_size);
+        if (nbytes <= 0) break;
+
+        sha256_update(&sha, dest, nbytes);
+        bytes_written += nbytes;
+        result = output_writer_commit(&writer, nbytes) ? 0 : 1;
+    }
+    while (result == 0 && base && (nbytes = zip_fread(file_in, ctx->in_buffer, ctx->in_size)) > 0) {
+        ZSTD_inBuffer input = { ctx->in_buffer, (size_t) nbytes, 0 };
+        BOOL output_full = FALSE;
+        // when the output is full, the decoder may still hold data after the input is consumed
+        while (input.pos < input.size || output_full) {
+            size_t block_size;
+            char *dest = output_writer_reserve(&writer, &block_size);
+            ZSTD_outBuffer output = { dest, block_size, 0 };
+            frame_remaining = ZSTD_decompressStream(ctx->dctx, &output, &input);
+            if (ZSTD_isError(frame_remaining)) {
+                result = 1;
+                break;
+            }
+            sha256_update(&sha, dest, output.pos);
+            bytes_written += output.pos;
+            output_full = output.pos == output.size;
+            if (!output_writer_commit(&writer, output.pos)) {
+                result = 1;
+                break;
+            }
+        }
+    }
+    if (nbytes < 0 || frame_remaining != 0) {
+        result = 1;
+    }
+    zip_fclose(file_in);
+
+    char digest[SHA256_HEX_SIZE];
+    sha256_final_hex(&sha, digest);
+    sha256_free(&sha);
+
+    if (!output_writer_close(&writer) || bytes_written != size || _stricmp(digest, sha256) != 0) {
+        result = 1;
+    }
+    return result;
+}
+
+// every changed file is first written and verified next to the installed one, and the installed files are only
+// replaced once the whole delta has been applied, so a delta that does not apply leaves the installed release untouched.
+// installed_files is the file list of the installed manifest, the one after the update is added to files
+int apply_delta(const char *delta_path, const char *from_commit, const char *to_commit, cJSON *installed_files, cJSON *files) {
+    double start_time = get_time_seconds();
+
+    int error;
+    zip_t *archive = zip_open(delta_path, ZIP_RDONLY, &error);
+    if (!archive) {
+        return 1;
+    }
+
+    int result = 1;
+    memory mem = {0};
+    memory base = {0};
+    cJSON *json = NULL;
+    delta_file *delta_files = NULL;
+    int num_delta_files = 0;
+    size_t bytes_total = 0;
+    size_t bytes_done = 0;
+
+    delta_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.archive = archive;
+    ctx.in_size = ZSTD_DStreamInSize();
+    ctx.in_buffer = (char *) malloc(ctx.in_size);
+    ctx.write_buffer = (char *) malloc(MAX_READ_SIZE);
+    ctx.dctx = ZSTD_createDCtx();
+    if (!ctx.in_buffer || !ctx.write_buffer || !ctx.dctx) goto finish;
+
+    // patches made with --long need a window as large as the file they patch
+    ZSTD_DCtx_setParameter(ctx.dctx, ZSTD_d_windowLogMax, DELTA_MAX_WINDOW_LOG);
+
+    zip_stat_t stat;
+    if (zip_stat(archive, DELTA_MANIFEST, 0, &stat) != 0 || !(stat.valid & ZIP_STAT_SIZE)) goto finish;
+
+    zip_file_t *manifest_in = zip_fopen(archive, DELTA_MANIFEST, 0);
+    if (!manifest_in) goto finish;
+    mem.data = (char *) malloc(stat.size + 1);
+    mem.size = mem.data ? zip_fread(manifest_in, mem.data, stat.size) : 0;
+    zip_fclose(manifest_in);
+
+    json = cJSON_ParseWithLength(mem.data, mem.size);
+    if (!json) goto finish;
+
+    char commit[STRING_SIZE] = {0};
+    copy_json_string(commit, json, "from");
+    if (strcmp(commit, from_commit) != 0) goto finish;
+    *commit = '\0';
+    copy_json_string(commit, json, "to");
+    if (strcmp(commit, to_commit) != 0) goto finish;
+
+    if (!installed_files) goto finish;
+
+    cJSON *json_files = cJSON_GetObjectItemCaseSensitive(json, "files");
+    if (!json_files || !cJSON_IsArray(json_files)) goto finish;
+
+    delta_files = (delta_file *) calloc(max(cJSON_GetArraySize(json_files), 1), sizeof(delta_file));
+    if (!delta_files) goto finish;
+
+    cJSON *json_file;
+    cJSON_ArrayForEach(json_file, json_files) {
+        bytes_total += get_json_size(json_file, "size");
+    }
+    progress_start(&updater_progress[PROGRESS_CLIENT], bytes_total);
+    start_install_writes();
+
+    cJSON_ArrayForEach(json_file, json_files) {
+        char path[STRING_SIZE] = {0};
+        char op[STRING_SIZE] = {0};
+        char sha256[STRING_SIZE] = {0};
+        copy_json_string(path, json_file, "path");
+        copy_json_string(op, json_file, "op");
+        copy_json_string(sha256, json_file, "sha256");
+        size_t size = get_json_size(json_file, "size");
+        if (is_staging_cancelled()) goto finish;
+
+        // paths must stay inside the install directory
+        if (!*path || *path == '/' || *path == '\\' || strstr(path, "..")) goto finish;
+
+        delta_file *file = &delta_files[num_delta_files++];
+        strncpy(file->path, concat_path(bang_base_dir, path), MAX_PATH - 1);
+        strncpy(file->output_path, concat_path(get_output_dir(), path), MAX_PATH - 1);
+        snprintf(file->temp_path, MAX_PATH, "%s.part", file->output_path);
+        if (staged_files_dir) {
+            // the staged tree only has the directories of the files that changed
+            make_parent_dirs(file->temp_path, strlen(staged_files_dir));
+        }
+
+        char entry_name[MAX_PATH];
+        double start = trace_begin();
+        if (strcmp(op, "remove") == 0) {
+            file->remove = TRUE;
+            *file->temp_path = '\0';
+            continue;
+        } else if (strcmp(op, "mkdir") == 0) {
+            make_dir(file->output_path);
+            *file->temp_path = '\0';
+            continue;
+        } else if (strcmp(op, "patch") == 0) {
+            set_install_status("Patch", path);
+            if (!read_file_to_memory(file->path, &base)) goto finish;
+
+            snprintf(entry_name, MAX_PATH, DELTA_PATCH_DIR "%s" DELTA_PATCH_EXTENSION, path);
+            if (write_delta_entry(&ctx, entry_name, &base, file->temp_path, size, sha256) != 0) goto finish;
+
+            free(base.data);
+            base.data = NULL;
+        } else if (strcmp(op, "add") == 0) {
+            set_install_status("Install", path);
+            snprintf(entry_name, MAX_PATH, DELTA_FILE_DIR "%s", path);
+            if (write_delta_entry(&ctx, entry_name, NULL, file->temp_path, size, sha256) != 0) goto finish;
+        } else {
+            goto finish;
+        }
+        trace_end("delta", path, start, size);
+
+        bytes_done += size;
+        progress_advance(&updater_progress[PROGRESS_CLIENT], bytes_done);
+    }
+
+    for (int i=0; i<num_delta_files; ++i) {
+        delta_file *file = &delta_files[i];
+        if (file->remove) {
+            // the files removed from a staged update are not in its list, the swap removes them
+            if (!staged_files_dir) {
+                remove_file(file->path);
+            }
+        } else if (*file->temp_path && !move_file(file->temp_path, file->output_path)) {
+            goto finish;
+        }
+    }
+
+    // the installed file list is carried over, without the removed files and with the added ones
+    cJSON *item;
+    cJSON_ArrayForEach(item, installed_files) {
+        if (!cJSON_IsString(item)) continue;
+        BOOL removed = FALSE;
+        cJSON_ArrayForEach(json_file, json_files) {
+            cJSON *json_path = cJSON_GetObjectItemCaseSensitive(json_file, "path");
+            cJSON *json_op = cJSON_GetObjectItemCaseSensitive(json_file, "op");
+            if (cJSON_IsString(json_path) && cJSON_IsString(json_op) && strcmp(cJSON_GetStringValue(json_op), "remove") == 0
+                && strcmp(cJSON_GetStringValue(json_path), cJSON_GetStringValue(item)) == 0) {
+                removed = TRUE;
+                break;
+            }
+        }
+        if (!removed) {
+            cJSON_AddItemToArray(files, cJSON_CreateString(cJSON_GetStringValue(item)));
+        }
+    }
+    cJSON_ArrayForEach(json_file, json_files) {
+        cJSON *json_path = cJSON_GetObjectItemCaseSensitive(json_file, "path");
+        cJSON *json_op = cJSON_GetObjectItemCaseSensitive(json_file, "op");
+        if (cJSON_IsString(json_path) && cJSON_IsString(json_op) && strcmp(cJSON_GetStringValue(json_op), "add") == 0
+            && !json_array_has_string(installed_files, cJSON_GetStringValue(json_path))) {
+            cJSON_AddItemToArray(files, cJSON_CreateString(cJSON_GetStringValue(json_path)));
+        }
+    }
+    result = 0;
+
+finish:
+    for (int i=0; i<num_delta_files; ++i) {
+        if (*delta_files[i].temp_path) {
+            remove_file(delta_files[i].temp_path);
+        }
+    }
+    free(delta_files);
+    free(base.data);
+    free(mem.data);
+    cJSON_Delete(json);
+    ZSTD_freeDCtx(ctx.dctx);
+    free(ctx.in_buffer);
+    free(ctx.write_buffer);
+    zip_discard(archive);
+
+    double end_time = get_time_seconds();
+    trace_span("delta", "apply_delta", start_time, end_time, bytes_done);
+    last_install_stats.unzip_time = end_time - start_time;
+    last_install_stats.unzip_bytes = bytes_done;
+    last_install_stats.unzip_skipped_bytes = 0;
+    last_install_stats.write_bytes = atomic_load(&install_bytes_written);
+    return result;
+}
+
+#else
+
+int apply_delta(const char *delta_path, const char *from_commit, const char *to_commit, cJSON *installed_files, cJSON *files) {
+    return 1;
+}
+
+#endif
+
+// the file index lets a verification trust the files that were not touched since they were installed and only hash
+// the others. the crc is the one that the release zip records for its entries, so damaged files can be fetched alone
+#define FILE_TRUSTED 0
+#define FILE_SUSPECT 1
+#define FILE_UNKNOWN 2
+#define FILE_DAMAGED 3
+
+typedef struct {
+    char path[MAX_PATH];
+    unsigned long long size;
+    unsigned long long mtime;
+    unsigned int crc;
+    int state;
+} indexed_file;
+
+typedef struct {
+    indexed_file *files;
+    long num_files;
+    size_t base_dir_length;
+
+    atomic_long next_file;
+    atomic_long hashed_files;
+    atomic_ullong hashed_bytes;
+} file_index;
+
+void init_file_index(file_index *index) {
+    memset(index, 0, sizeof(file_index));
+    index->base_dir_length = strlen(bang_base_dir) + 1;
+}
+
+int compare_indexed_files(const void *lhs, const void *rhs) {
+    return strcmp(((const indexed_file *) lhs)->path, ((const indexed_file *) rhs)->path);
+}
+
+indexed_file *find_indexed_file(const file_index *index, const char *path) {
+    if (index->num_files == 0) return NULL;
+
+    indexed_file key;
+    strncpy(key.path, path, MAX_PATH - 1);
+    key.path[MAX_PATH - 1] = '\0';
+    return (indexed_file *) bsearch(&key, index->files, index->num_files, sizeof(indexed_file), compare_indexed_files);
+}
+
+// numbers are stored as doubles, integers are exact up to 2^53 which is enough for timestamps in microseconds
+unsigned long long get_json_integer(cJSON *json, const char *name) {
+    cJSON *json_value = cJSON_GetObjectItemCaseSensitive(json, name);
+    return json_value && cJSON_IsNumber(json_value) ? (unsigned long long) cJSON_GetNumberValue(json_value) : 0;
+}
+
+// an index is only valid for the release it was written for, unless commit is NULL
+BOOL read_file_index(file_index *index, const char *commit) {
+    init_file_index(index);
+
+    cJSON *json = read_json_file(concat_path(bang_base_dir, FILE_INDEX));
+    if (!json) return FALSE;
+
+    cJSON *json_commit = cJSON_GetObjectItemCaseSensitive(json, "commit");
+    cJSON *json_files = cJSON_GetObjectItemCaseSensitive(json, "files");
+    if (!cJSON_IsArray(json_files) || (commit && (!cJSON_IsString(json_commit) || strcmp(cJSON_GetStringValue(json_commit), commit) != 0))) {
+        cJSON_Delete(json);
+        return FALSE;
+    }
+
+    index->files = (indexed_file *) malloc(max(cJSON_GetArraySize(json_files), 1) * sizeof(indexed_file));
+    if (!index->files) {
+        cJSON_Delete(json);
+        return FALSE;
+    }
+
+    cJSON *json_file;
+    cJSON_ArrayForEach(json_file, json_files) {
+        cJSON *json_path = cJSON_GetObjectItemCaseSensitive(json_file, "path");
+        if (!cJSON_IsString(json_path)) continue;
+
+        indexed_file *file = &index->files[index->num_files++];
+        strncpy(file->path, concat_path(bang_base_dir, cJSON_GetStringValue(json_path)), MAX_PATH - 1);
+        file->path[MAX_PATH - 1] = '\0';
+        file->size = get_json_integer(json_file, "size");
+        file->mtime = get_json_integer(json_file, "mtime");
+        file->crc = (unsigned int) get_json_integer(json_file, "crc");
+        file->state = FILE_TRUSTED;
+    }
+    cJSON_Delete(json);
+
+    qsort(index->files, index->num_files, sizeof(indexed_file), compare_indexed_files);
+    return TRUE;
+}
+
+// damaged files are written with the size and crc they should have, so that they are still reported next time
+void write_file_index(const file_index *index, const char *commit) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "commit", commit);
+    cJSON *json_files = cJSON_CreateArray();
+    cJSON_AddItemToObject(json, "files", json_files);
+
+    for (long i=0; i<index->num_files; ++i) {
+        const indexed_file *file = &index->files[i];
+        cJSON *json_file = cJSON_CreateObject();
+        cJSON_AddStringToObject(json_file, "path", file->path + index->base_dir_length);
+        cJSON_AddNumberToObject(json_file, "size", (double) file->size);
+        cJSON_AddNumberToObject(json_file, "mtime", (double) file->mtime);
+        cJSON_AddNumberToObject(json_file, "crc", file->crc);
+        cJSON_AddItemToArray(json_files, json_file);
+    }
+
+    char *str = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+
+    if (str) {
+        FILE *file_out = fopen(concat_path(bang_base_dir, FILE_INDEX), "wb");
+        if (file_out) {
+            fputs(str, file_out);
+            fclose(file_out);
+        }
+        cJSON_free(str);
+    }
+}
+
+// each worker takes the next file until the list is exhausted, only suspect and unknown files are read.
+// a suspect file is damaged if its crc changed, otherwise it is trusted again with its new modification time
+int hash_worker(void *param) {
+    file_index *index = (file_index *) param;
+    char *buffer = (char *) malloc(MAX_READ_SIZE);
+
+    long i;
+    while ((i = atomic_fetch_add(&index->next_file, 1)) < index->num_files) {
+        indexed_file *file = &index->files[i];
+        if (file->state != FILE_SUSPECT && file->state != FILE_UNKNOWN) continue;
+
+        double start = trace_begin();
+        unsigned long long size;
+        unsigned long long mtime;
+        unsigned int crc;
+        if (!buffer || !get_file_info(file->path, &size, &mtime) || !compute_file_crc(file->path, buffer, MAX_READ_SIZE, &crc)) {
+            file->state = FILE_DAMAGED;
+        } else if (file->state == FILE_SUSPECT && (size != file->size || crc != file->crc)) {
+            file->state = FILE_DAMAGED;
+        } else {
+            file->size = size;
+            file->mtime = mtime;
+            file->crc = crc;
+            file->state = FILE_TRUSTED;
+        }
+        trace_end("verify", file->path + index->base_dir_length, start, file->size);
+
+        atomic_fetch_add(&index->hashed_files, 1);
+        unsigned long long bytes_done = atomic_fetch_add(&index->hashed_bytes, file->size) + file->size;
+        progress_advance(&updater_progress[PROGRESS_CLIENT], bytes_done);
+    }
+
+    free(buffer);
+    return 0;
+}
+
+void hash_files(file_index *index) {
+    unsigned long long bytes_total = 0;
+    long num_files = 0;
+    for (long i=0; i<index->num_files; ++i) {
+        if (index->files[i].state == FILE_SUSPECT || index->files[i].state == FILE_UNKNOWN) {
+            bytes_total += index->files[i].size;
+            ++num_files;
+        }
+    }
+    if (num_files == 0) return;
+
+    progress_start(&updater_progress[PROGRESS_CLIENT], bytes_total);
+    atomic_store(&index->next_file, 0);
+
+    int num_workers = min(get_num_cpus(), MAX_UNZIP_WORKERS);
+    num_workers = max(min(num_workers, (int) num_files), 1);
+
+    thread_t workers[MAX_UNZIP_WORKERS];
+    int num_threads = 0;
+    for (int i=1; i<num_workers; ++i) {
+        if (thread_create(&workers[num_threads], hash_worker, index)) {
+            ++num_threads;
+        }
+    }
+    hash_worker(index);
+
+    for (int i=0; i<num_threads; ++i) {
+        thread_join(&workers[i]);
+    }
+}
+
+// the fast pass, which only stats the files: a file is missing or damaged if its size changed,
+// and suspect if it was written since it was indexed
+void check_indexed_files(file_index *index) {
+    for (long i=0; i<index->num_files; ++i) {
+        indexed_file *file = &index->files[i];
+        unsigned long long size;
+        unsigned long long mtime;
+        if (!get_file_info(file->path, &size, &mtime) || size != file->size) {
+            file->state = FILE_DAMAGED;
+        } else if (mtime != file->mtime) {
+            file->state = FILE_SUSPECT;
+        }
+    }
+}
+
+void add_indexed_file(file_index *index, const char *name, const file_index *known, const file_index *previous) {
+    indexed_file *file = &index->files[index->num_files];
+    strncpy(file->path, concat_path(bang_base_dir, name), MAX_PATH - 1);
+    file->path[MAX_PATH - 1] = '\0';
+    if (!get_file_info(file->path, &file->size, &file->mtime)) return;
+
+    const indexed_file *found = find_indexed_file(known, file->path);
+    if (found) {
+        file->crc = found->crc;
+        file->state = FILE_TRUSTED;
+    } else if ((found = find_indexed_file(previous, file->path)) && found->state == FILE_TRUSTED
+        && found->size == file->size && found->mtime == file->mtime) {
+        file->crc = found->crc;
+        file->state = FILE_TRUSTED;
+    } else {
+        file->state = FILE_UNKNOWN;
+    }
+    ++index->num_files;
+}
+
+// the crcs collected while extracting, keyed by relative path
+void read_known_crcs(file_index *index, cJSON *crcs) {
+    init_file_index(index);
+    if (!crcs) return;
+
+    index->files = (indexed_file *) malloc(max(cJSON_GetArraySize(crcs), 1) * sizeof(indexed_file));
+    if (!index->files) return;
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, crcs) {
+        if (!cJSON_IsNumber(item) || !item->string) continue;
+
+        indexed_file *file = &index->files[index->num_files++];
+        strncpy(file->path, concat_path(bang_base_dir, item->string), MAX_PATH - 1);
+        file->path[MAX_PATH - 1] = '\0';
+        file->crc = (unsigned int) cJSON_GetNumberValue(item);
+        file->state = FILE_TRUSTED;
+    }
+    qsort(index->files, index->num_files, sizeof(indexed_file), compare_indexed_files);
+}
+
+// called at the end of an install with the list of installed files, and the crcs of the zip entries for the ones that
+// were extracted or found unchanged. the other files keep their crc if their size and modification time did not change
+// since the previous index, only the ones that are left are hashed
+void update_file_index(cJSON *files, cJSON *crcs, const char *commit) {
+    double start_time = get_time_seconds();
+
+    file_index known;
+    read_known_crcs(&known, crcs);
+    file_index previous;
+    read_file_index(&previous, NULL);
+
+    file_index index;
+    init_file_index(&index);
+    index.files = (indexed_file *) malloc((cJSON_GetArraySize(files) + 1) * sizeof(indexed_file));
+    if (index.files) {
+        // cards.pak is downloaded on its own, it is not one of the extracted files
+        add_indexed_file(&index, "cards.pak", &known, &previous);
+        cJSON *item;
+        cJSON_ArrayForEach(item, files) {
+            if (cJSON_IsString(item)) {
+                add_indexed_file(&index, cJSON_GetStringValue(item), &known, &previous);
+            }
+        }
+        qsort(index.files, index.num_files, sizeof(indexed_file), compare_indexed_files);
+
+        set_status("Install: indexing %ld files", index.num_files);
+        hash_files(&index);
+        write_file_index(&index, commit);
+    }
+
+    trace_end("verify", "update_file_index", start_time, atomic_load(&index.hashed_bytes));
+    free(index.files);
+    free(known.files);
+    free(previous.files);
+}
+
+// a delta is only used when it starts from the installed release and it can be applied by this build
+BOOL has_matching_delta(const installed_version *installed) {
+#ifdef BANG_HAVE_ZSTD
+    return *bang_zip_information.delta_url && strcmp(bang_zip_information.delta_from_commit, installed->client_commit) == 0;
+#else
+    return FALSE;
+#endif
+}
+
+// when the release has a chunk index and the installed cards.pak has one too, the new cards.pak is rebuilt from the
+// installed one and only the chunks that changed are downloaded. the index is saved to index_path for the next release.
+// installed_path is given by the caller, this runs on the cards thread and must not use the buffer of concat_path
+int fetch_cards_pak(const char *path, const char *index_path, const char *installed_path, char *sha256, size_t *bytes_downloaded, downloading_callback callback, void *params) {
+    char installed_index_path[MAX_PATH];
+    snprintf(installed_index_path, MAX_PATH, "%s" CHUNK_INDEX_EXTENSION, installed_path);
+
+    memory index = {0};
+    if (*bang_zip_information.cards_index_url) {
+        download_file(&index, bang_zip_information.cards_index_url, download_query_size, NULL, NULL);
+    }
+
+    int errcode = error_cant_access_site;
+    if (index.data && file_exists(installed_path) && file_exists(installed_index_path)) {
+        errcode = download_file_chunked(path, bang_zip_information.cards_pak_url, &index, installed_path, installed_index_path,
+            sha256, bytes_downloaded, callback, params);
+        if (errcode == error_ok && *bang_zip_information.cards_pak_sha256 && _stricmp(sha256, bang_zip_information.cards_pak_sha256) != 0) {
+            remove_file(path);
+            errcode = error_checksum_mismatch;
+        }
+    }
+    if (errcode != error_ok) {
+        errcode = download_file_to_disk(path, bang_zip_information.cards_pak_url, bang_zip_information.cards_pak_size,
+            bang_zip_information.cards_pak_sha256, sha256, callback, params);
+        *bytes_downloaded = bang_zip_information.cards_pak_size;
+    }
+
+    // an index left from a previous release would not describe the new file
+    remove_file(index_path);
+    if (errcode == error_ok && index.data) {
+        FILE *file_out = fopen(index_path, "wb");
+        if (file_out) {
+            fwrite(index.data, 1, index.size, file_out);
+            fclose(file_out);
+        }
+    }
+    free(index.data);
+    return errcode;
+}
+
+// an entry is only fetched if the installed file differs from it, the result is kept for unzip_worker.
+// params is a buffer of MAX_READ_SIZE bytes
+BOOL is_zip_entry_changed(const char *name, size_t size, unsigned int crc, void *params) {
+    const char *slash_pos = strchr(name, '/');
+    if (!slash_pos || name[strlen(name) - 1] == '/') return FALSE;
+
+    const char *path = concat_path(bang_base_dir, slash_pos + 1);
+    return !is_directory(path) && check_installed_file(path, size, crc, (char *) params) == ENTRY_CHANGED;
+}
+
+// when a release is already installed, only the entries of the game zip that changed are fetched with range requests,
+// into a sparse copy of the zip that unzip_bang_zip reads like the whole one. otherwise, or if the server does not
+// serve ranges, the whole zip is downloaded and checked against its digest
+int download_bang_zip(const char *path, size_t *bytes_downloaded, downloading_callback callback, void *params) {
+    char journal_path[MAX_PATH];
+    snprintf(journal_path, MAX_PATH, "%s.journal", path);
+
+    // a full download that was interrupted is resumed rather than replaced
+    int errcode = error_range_ignored;
+    clear_checked_entries();
+    char *buffer = (char *) malloc(MAX_READ_SIZE);
+    if (buffer && bang_zip_information.zip_size != 0 && !file_exists(journal_path) && file_exists(concat_path(bang_base_dir, CLIENT_LIBRARY_NAME))) {
+        errcode = download_zip_entries(path, bang_zip_information.zip_url, bang_zip_information.zip_size,
+            is_zip_entry_changed, buffer, bytes_downloaded, callback, params);
+    }
+    free(buffer);
+    if (errcode != error_ok) {
+        errcode = download_file_to_disk(path, bang_zip_information.zip_url, bang_zip_information.zip_size,
+            bang_zip_information.zip_sha256, NULL, callback, params);
+        *bytes_downloaded = bang_zip_information.zip_size;
+    }
+    // the comparisons only hold for the extraction that follows
+    if (errcode != error_ok) {
+        clear_checked_entries();
+    }
+    return errcode;
+}
+
+typedef struct {
+    char path[MAX_PATH];
+    char sha256[SHA256_HEX_SIZE];
+} cards_pak_download;
+
+int download_cards_pak(void *param) {
+    cards_pak_download *cards_pak = (cards_pak_download *) param;
+    progress_counter *progress = &updater_progress[PROGRESS_CARDS];
+    progress_start(progress, bang_zip_information.cards_pak_size);
+
+    // downloads go to a temporary file so that an interrupted transfer never replaces a working cards.pak
+    char temp_path[MAX_PATH];
+    char index_path[MAX_PATH];
+    snprintf(temp_path, MAX_PATH, "%s.part", cards_pak->path);
+    snprintf(index_path, MAX_PATH, "%s" CHUNK_INDEX_EXTENSION, cards_pak->path);
+    double start_time = get_time_seconds();
+    size_t bytes_downloaded = 0;
+    int errcode = fetch_cards_pak(temp_path, index_path, cards_pak->path, cards_pak->sha256, &bytes_downloaded, publish_download_progress, progress);
+    if (errcode != error_ok) {
+        return errcode;
+    }
+    last_install_stats.cards_download_time = get_time_seconds() - start_time;
+    last_install_stats.cards_download_bytes = bytes_downloaded;
+    if (!move_file(temp_path, cards_pak->path)) {
+        remove_file(temp_path);
+        return error_cant_write_file;
+    }
+    return error_ok;
+}
+
+int install_latest_version() {
+    set_status("Download: %s...", bang_zip_information.version);
+
+    int errcode = error_ok;
+    memset(&last_install_stats, 0, sizeof(last_install_stats));
+
+    if (!file_exists(bang_base_dir)) {
+        make_dir(bang_base_dir);
+    }
+
+    installed_version installed;
+    get_installed_version(&installed);
+
+    // the digest of the installed cards.pak is kept unless a new one is downloaded
+    cards_pak_download cards_pak;
+    strncpy(cards_pak.path, concat_path(bang_base_dir, "cards.pak"), MAX_PATH);
+    strncpy(cards_pak.sha256, installed.cards_sha256, SHA256_HEX_SIZE);
+
+    char manifest_path[MAX_PATH];
+    strncpy(manifest_path, concat_path(bang_base_dir, VERSION_MANIFEST), MAX_PATH);
+    cJSON *installed_files = read_manifest_files(manifest_path);
+
+    // cards.pak is fetched on its own thread while this one downloads and installs the game zip
+    thread_t cards_thread;
+    BOOL cards_thread_started = FALSE;
+    if (bang_zip_information.cards_pak_size != 0 && (!file_exists(cards_pak.path) || must_download_cards_pak())) {
+        cards_thread_started = thread_create(&cards_thread, download_cards_pak, &cards_pak);
+        if (!cards_thread_started) {
+            errcode = download_cards_pak(&cards_pak);
+        }
+    }
+    remove_file(manifest_path);
+
+    cJSON *files = cJSON_CreateArray();
+    cJSON *crcs = cJSON_CreateObject();
+    progress_counter *progress = &updater_progress[PROGRESS_CLIENT];
+    char temp_path[MAX_PATH];
+
+    if (errcode == error_ok && installed_files && has_matching_delta(&installed)) {
+        progress_start(progress, bang_zip_information.delta_size);
+
+        strncpy(temp_path, concat_path(bang_base_dir, "update.delta.part"), MAX_PATH);
+        double start_time = get_time_seconds();
+        if (download_file_to_disk(temp_path, bang_zip_information.delta_url, bang_zip_information.delta_size,
+            bang_zip_information.delta_sha256, NULL, publish_download_progress, progress) == error_ok) {
+            last_install_stats.zip_download_time = get_time_seconds() - start_time;
+            last_install_stats.zip_download_bytes = bang_zip_information.delta_size;
+
+            last_install_stats.from_delta = apply_delta(temp_path, installed.client_commit, bang_zip_information.commit, installed_files, files) == 0;
+        }
+        remove_file(temp_path);
+
+        // a delta that cannot be downloaded or applied falls back to the full release
+        if (!last_install_stats.from_delta) {
+            printf("Delta update failed, downloading %s\n", bang_zip_information.zip_url);
+            cJSON_Delete(files);
+            files = cJSON_CreateArray();
+        }
+    }
+    cJSON_Delete(installed_files);
+
+    if (errcode == error_ok && !last_install_stats.from_delta) {
+        progress_start(progress, bang_zip_information.zip_size);
+
+        strncpy(temp_path, concat_path(bang_base_dir, "update.zip.part"), MAX_PATH);
+        double start_time = get_time_seconds();
+        size_t bytes_downloaded = 0;
+        errcode = download_bang_zip(temp_path, &bytes_downloaded, publish_download_progress, progress);
+        if (errcode == error_ok) {
+            last_install_stats.zip_download_time = get_time_seconds() - start_time;
+            last_install_stats.zip_download_bytes = bytes_downloaded;
+
+            if (extract_bang_archive(temp_path, files, crcs) != 0) {
+                errcode = error_cant_write_file;
+            }
+            remove_file(temp_path);
+        }
+    }
+
+    if (cards_thread_started) {
+        int cards_errcode = thread_join(&cards_thread);
+        if (cards_errcode != error_ok && errcode == error_ok) {
+            errcode = cards_errcode;
+        }
+    }
+
+    if (errcode == error_ok) {
+        installed_version version;
+        strncpy(version.client_commit, bang_zip_information.commit, STRING_SIZE);
+        strncpy(version.cards_commit, bang_zip_information.cards_commit, STRING_SIZE);
+        strncpy(version.cards_sha256, cards_pak.sha256, SHA256_HEX_SIZE);
+        update_file_index(files, crcs, version.client_commit);
+        write_version_manifest(manifest_path, &version, NULL, files, NULL);
+    } else {
+        cJSON_Delete(files);
+    }
+    cJSON_Delete(crcs);
+    return errcode;
+}
+
+BOOL read_staged_base_commit(const char *marker_path, char *base_commit) {
+    *base_commit = '\0';
+    cJSON *json = read_json_file(marker_path);
+    if (!json) return FALSE;
+
+    copy_json_string(base_commit, json, "base_commit");
+    cJSON_Delete(json);
+    return *base_commit != '\0';
+}
+
+int stage_latest_version() {
+    int result = FALSE;
+    int errcode = must_download_latest_version(&result);
+    if (errcode != error_ok || !result) {
+        return errcode;
+    }
+
+    char staging_dir[MAX_PATH];
+    char marker_path[MAX_PATH];
+    char files_dir[MAX_PATH];
+    char path[MAX_PATH];
+    strncpy(staging_dir, concat_path(bang_base_dir, STAGING_DIR), MAX_PATH);
+    strncpy(marker_path, concat_path(staging_dir, STAGED_MARKER), MAX_PATH);
+    strncpy(files_dir, concat_path(staging_dir, STAGED_FILES_DIR), MAX_PATH);
+
+    installed_version version;
+    get_installed_version(&version);
+    char base_commit[STRING_SIZE];
+    strncpy(base_commit, version.client_commit, STRING_SIZE);
+
+    // the release is checked again during long sessions
+    installed_version staged;
+    char staged_base_commit[STRING_SIZE];
+    if (read_version_manifest(marker_path, &staged) && read_staged_base_commit(marker_path, staged_base_commit)
+        && strcmp(staged.client_commit, bang_zip_information.commit) == 0
+        && strcmp(staged.cards_commit, bang_zip_information.cards_commit) == 0
+        && strcmp(staged_base_commit, base_commit) == 0) {
+        return error_ok;
+    }
+
+    make_dir(staging_dir);
+    remove_file(marker_path);
+    set_download_rate_limit(stage_rate_limit);
+
+    cJSON *files = NULL;
+    cJSON *crcs = NULL;
+
+    char index_path[MAX_PATH];
+    char installed_path[MAX_PATH];
+    strncpy(path, concat_path(staging_dir, "cards.pak"), MAX_PATH);
+    snprintf(index_path, MAX_PATH, "%s" CHUNK_INDEX_EXTENSION, path);
+    strncpy(installed_path, concat_path(bang_base_dir, "cards.pak"), MAX_PATH);
+    if (bang_zip_information.cards_pak_size != 0 && must_download_cards_pak()) {
+        size_t bytes_downloaded;
+        errcode = fetch_cards_pak(path, index_path, installed_path, version.cards_sha256, &bytes_downloaded, NULL, NULL);
+        if (errcode != error_ok) goto finish;
+    } else {
+        remove_file(path);
+        remove_file(index_path);
+    }
+
+    // the release is extracted now rather than at the next start: the files that differ from the install
+    // are written to the staged tree, and the next start only has to rename them
+    remove_dir(files_dir);
+    make_dir(files_dir);
+    staged_files_dir = files_dir;
+    files = cJSON_CreateArray();
+    crcs = cJSON_CreateObject();
+
+    // a delta applies to the install as it is now, the full release is the fallback
+    cJSON *installed_files = read_manifest_files(concat_path(bang_base_dir, VERSION_MANIFEST));
+    errcode = error_cant_access_site;
+    if (installed_files && has_matching_delta(&version)) {
+        strncpy(path, concat_path(staging_dir, "update.delta"), MAX_PATH);
+        errcode = download_file_to_disk(path, bang_zip_information.delta_url, bang_zip_information.delta_size,
+            bang_zip_information.delta_sha256, NULL, NULL, NULL);
+        if (errcode == error_ok) {
+            if (apply_delta(path, version.client_commit, bang_zip_information.commit, installed_files, files) != 0) {
+                errcode = error_cant_write_file;
+                cJSON_Delete(files);
+                files = cJSON_CreateArray();
+            }
+            remove_file(path);
+        }
+    }
+    cJSON_Delete(installed_files);
+
+    if (errcode != error_ok) {
+        strncpy(path, concat_path(staging_dir, "update.zip"), MAX_PATH);
+        size_t bytes_downloaded;
+        errcode = download_bang_zip(path, &bytes_downloaded, NULL, NULL);
+        if (errcode == error_ok) {
+            if (extract_bang_archive(path, files, crcs) != 0) {
+                errcode = error_cant_write_file;
+            }
+            remove_file(path);
+        }
+    }
+    staged_files_dir = NULL;
+
+finish:
+    if (errcode == error_ok) {
+        strncpy(version.client_commit, bang_zip_information.commit, STRING_SIZE);
+        strncpy(version.cards_commit, bang_zip_information.cards_commit, STRING_SIZE);
+        write_version_manifest(marker_path, &version, base_commit, files, crcs);
+    } else {
+        cJSON_Delete(files);
+        cJSON_Delete(crcs);
+    }
+    set_download_rate_limit(0);
+    return errcode;
+}
+
+void cancel_staging() {
+    atomic_store(&stage_cancelled, TRUE);
+    cancel_downloads();
+}
+
+int apply_staged_update() {
+    char staging_dir[MAX_PATH];
+    char marker_path[MAX_PATH];
+    char files_dir[MAX_PATH];
+    char staged_path[MAX_PATH];
+    strncpy(staging_dir, concat_path(bang_base_dir, STAGING_DIR), MAX_PATH);
+    strncpy(marker_path, concat_path(staging_dir, STAGED_MARKER), MAX_PATH);
+    strncpy(files_dir, concat_path(staging_dir, STAGED_FILES_DIR), MAX_PATH);
+
+    installed_version version;
+    if (!read_version_manifest(marker_path, &version)) {
+        return 0;
+    }
+    double start_time = get_time_seconds();
+
+    // the staged files replace those of the install they were prepared against, and nothing else. an update staged
+    // for another install, or by a launcher that extracted the archive at the next start, is dropped
+    // and the release is installed as usual instead
+    installed_version installed;
+    get_installed_version(&installed);
+    char base_commit[STRING_SIZE];
+    cJSON *files = read_manifest_files(marker_path);
+    if (!files || !read_staged_base_commit(marker_path, base_commit) || strcmp(base_commit, installed.client_commit) != 0) {
+        cJSON_Delete(files);
+        remove_file(concat_path(staging_dir, "update.zip"));
+        remove_file(concat_path(staging_dir, "update.delta"));
+        remove_file(concat_path(staging_dir, "cards.pak"));
+        remove_file(concat_path(staging_dir, "cards.pak" CHUNK_INDEX_EXTENSION));
+        remove_dir(files_dir);
+        remove_file(marker_path);
+        return 0;
+    }
+
+    char manifest_path[MAX_PATH];
+    strncpy(manifest_path, concat_path(bang_base_dir, VERSION_MANIFEST), MAX_PATH);
+    cJSON *installed_files = read_manifest_files(manifest_path);
+
+    int result = 0;
+    strncpy(staged_path, concat_path(staging_dir, "cards.pak"), MAX_PATH);
+    char staged_index_path[MAX_PATH];
+    strncpy(staged_index_path, concat_path(staging_dir, "cards.pak" CHUNK_INDEX_EXTENSION), MAX_PATH);
+    if (file_exists(staged_path)) {
+        if (!move_file(staged_path, concat_path(bang_base_dir, "cards.pak"))) {
+            result = 1;
+        }
+        // the index of the previous cards.pak is replaced, or dropped if the release had none
+        if (!file_exists(staged_index_path) || !move_file(staged_index_path, concat_path(bang_base_dir, "cards.pak" CHUNK_INDEX_EXTENSION))) {
+            remove_file(concat_path(bang_base_dir, "cards.pak" CHUNK_INDEX_EXTENSION));
+        }
+    }
+
+    // the files that were not staged are the same in both releases. the marker and the previous manifest are only
+    // replaced at the end, so a swap that is interrupted is finished by the next start with the files still staged
+    char installed_path[MAX_PATH];
+    cJSON *item;
+    cJSON_ArrayForEach(item, files) {
+        if (result != 0) break;
+        if (!cJSON_IsString(item)) continue;
+
+        strncpy(staged_path, concat_path(files_dir, cJSON_GetStringValue(item)), MAX_PATH);
+        if (!file_exists(staged_path)) continue;
+
+        strncpy(installed_path, concat_path(bang_base_dir, cJSON_GetStringValue(item)), MAX_PATH);
+        make_parent_dirs(installed_path, strlen(bang_base_dir));
+        if (!move_file(staged_path, installed_path)) {
+            result = 1;
+        }
+    }
+
+    // files of the installed release that the staged one does not have
+    if (result == 0) {
+        cJSON_ArrayForEach(item, installed_files) {
+            if (cJSON_IsString(item) && !json_array_has_string(files, cJSON_GetStringValue(item))) {
+                remove_file(concat_path(bang_base_dir, cJSON_GetStringValue(item)));
+            }
+        }
+    }
+    cJSON_Delete(installed_files);
+
+    if (result != 0) {
+        // the install is a mix of both releases. the previous manifest, the marker and the files not moved yet are
+        // kept, so the next start finishes the swap, or the next install replaces the whole release
+        cJSON_Delete(files);
+        trace_end("stage", "apply_staged_update", start_time, -1);
+        return result;
+    }
+
+    cJSON *crcs = read_manifest_crcs(marker_path);
+    update_file_index(files, crcs, version.client_commit);
+    cJSON_Delete(crcs);
+    write_version_manifest(manifest_path, &version, NULL, files, NULL);
+
+    // the marker goes last: if it is still there, either the previous manifest is too and the swap is finished,
+    // or the base commit no longer matches and the staged update is dropped
+    remove_dir(files_dir);
+    remove_file(marker_path);
+    trace_end("stage", "apply_staged_update", start_time, -1);
+    return result;
+}
+
+// accepts the zip entries of the files that the verification found missing or damaged
+BOOL is_zip_entry_damaged(const char *name, size_t size, unsigned int crc, void *params) {
+    const char *slash_pos = strchr(name, '/');
+    if (!slash_pos || name[strlen(name) - 1] == '/') return FALSE;
+
+    const indexed_file *file = find_indexed_file((const file_index *) params, concat_path(bang_base_dir, slash_pos + 1));
+    return file && file->state == FILE_DAMAGED;
+}
+
+// the damaged files are fetched from the installed release: cards.pak is rebuilt from its intact chunks,
+// and only the damaged entries of the game zip are downloaded and extracted
+int repair_files(file_index *index) {
+    int errcode = error_ok;
+    BOOL zip_damaged = FALSE;
+
+    indexed_file *cards_file = find_indexed_file(index, concat_path(bang_base_dir, "cards.pak"));
+    for (long i=0; i<index->num_files; ++i) {
+        if (index->files[i].state == FILE_DAMAGED && &index->files[i] != cards_file) {
+            zip_damaged = TRUE;
+        }
+    }
+
+    if (cards_file && cards_file->state == FILE_DAMAGED) {
+        set_status("Repair: cards.pak");
+        cards_pak_download cards_pak;
+        strncpy(cards_pak.path, cards_file->path, MAX_PATH);
+        errcode = download_cards_pak(&cards_pak);
+    }
+
+    if (errcode == error_ok && zip_damaged) {
+        set_status("Repair: %s", bang_zip_information.version);
+        progress_counter *progress = &updater_progress[PROGRESS_CLIENT];
+        progress_start(progress, bang_zip_information.zip_size);
+
+        char temp_path[MAX_PATH];
+        strncpy(temp_path, concat_path(bang_base_dir, "repair.zip.part"), MAX_PATH);
+        size_t bytes_downloaded = 0;
+        errcode = error_range_ignored;
+        if (bang_zip_information.zip_size != 0) {
+            errcode = download_zip_entries(temp_path, bang_zip_information.zip_url, bang_zip_information.zip_size,
+                is_zip_entry_damaged, index, &bytes_downloaded, publish_download_progress, progress);
+        }
+        if (errcode != error_ok) {
+            errcode = download_file_to_disk(temp_path, bang_zip_information.zip_url, bang_zip_information.zip_size,
+                bang_zip_information.zip_sha256, NULL, publish_download_progress, progress);
+        }
+        if (errcode == error_ok) {
+            if (unzip_bang_entries(temp_path, NULL, NULL, is_zip_entry_damaged, index) != 0) {
+                errcode = error_cant_write_file;
+            }
+            remove_file(temp_path);
+        }
+    }
+
+    // the repaired files are checked against the index like the others
+    for (long i=0; i<index->num_files; ++i) {
+        if (index->files[i].state == FILE_DAMAGED) {
+            index->files[i].state = FILE_SUSPECT;
+        }
+    }
+    hash_files(index);
+    return errcode;
+}
+
+long count_damaged_files(const file_index *index) {
+    long num_damaged = 0;
+    for (long i=0; i<index->num_files; ++i) {
+        if (index->files[i].state == FILE_DAMAGED) {
+            ++num_damaged;
+        }
+    }
+    return num_damaged;
+}
+
+int verify_installation(BOOL repair) {
+    double start_time = get_time_seconds();
+    memset(&last_verify_stats, 0, sizeof(last_verify_stats));
+    set_status("Verify: %s", bang_base_dir);
+
+    installed_version installed;
+    file_index index;
+    init_file_index(&index);
+    if (!read_version_manifest(concat_path(bang_base_dir, VERSION_MANIFEST), &installed) || !read_file_index(&index, installed.client_commit)) {
+        // without an index the files can only be compared with the entries of the release zip, which is what an install does
+        free(index.files);
+        last_verify_stats.time = get_time_seconds() - start_time;
+        return repair ? install_latest_version() : error_checksum_mismatch;
+    }
+
+    check_indexed_files(&index);
+    hash_files(&index);
+
+    int errcode = error_ok;
+    long num_damaged = count_damaged_files(&index);
+    last_verify_stats.num_files = index.num_files;
+    last_verify_stats.damaged_files = num_damaged;
+
+    if (num_damaged != 0 && repair) {
+        if (strcmp(installed.client_commit, bang_zip_information.commit) != 0 || strcmp(installed.cards_commit, bang_zip_information.cards_commit) != 0) {
+            // the installed release is not the latest one, installing the new release replaces whatever is damaged
+            free(index.files);
+            errcode = install_latest_version();
+            last_verify_stats.repaired_files = errcode == error_ok ? num_damaged : 0;
+            last_verify_stats.time = get_time_seconds() - start_time;
+            return errcode;
+        }
+        errcode = repair_files(&index);
+        long num_left = count_damaged_files(&index);
+        last_verify_stats.repaired_files = num_damaged - num_left;
+        num_damaged = num_left;
+    }
+    if (errcode == error_ok && num_damaged != 0) {
+        errcode = error_checksum_mismatch;
+    }
+
+    // suspect files that turned out to be intact are trusted from now on
+    write_file_index(&index, installed.client_commit);
+
+    last_verify_stats.hashed_files = atomic_load(&index.hashed_files);
+    last_verify_stats.hashed_bytes = atomic_load(&index.hashed_bytes);
+    last_verify_stats.time = get_time_seconds() - start_time;
+    trace_span("verify", "verify_installation", start_time, get_time_seconds(), last_verify_stats.hashed_bytes);
+
+    set_status("Verify: %ld files, %ld damaged", index.num_files, num_damaged);
+    free(index.files);
+    return errcode;
+}
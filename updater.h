@@ -0,0 +1,156 @@
+#ifndef __UPDATER_H__
+#define __UPDATER_H__
+
+#include <stdatomic.h>
+
+#include "sys.h"
+
+#define STAGING_DIR "staging"
+#define STAGED_MARKER "version.json"
+// the files of the staged release that differ from the installed ones, under their install paths
+#define STAGED_FILES_DIR "files"
+
+// a staged release is downloaded at this rate by default, in bytes per second, so that the game keeps the rest
+#define STAGE_RATE_LIMIT (1024 * 1024)
+// seconds between two release checks while the game is running
+#define STAGE_CHECK_INTERVAL (30 * 60)
+#define VERSION_MANIFEST "version.json"
+
+// size, modification time and crc of every installed file, written at install time for verify_installation
+#define FILE_INDEX "file_index.json"
+
+// release assets named "delta-<commit>.zip" update the install of that (possibly abbreviated) commit to the release
+#define DELTA_ASSET_PREFIX "delta-"
+#define DELTA_ASSET_EXTENSION ".zip"
+#define MIN_COMMIT_PREFIX 7
+
+// chunk index of cards.pak, it is kept next to the installed cards.pak so that the next release only downloads changed chunks
+#define CARDS_INDEX_ASSET "cards.pak.chunks"
+
+#define DEFAULT_API_BASE_URL "https://api.github.com"
+
+typedef struct {
+
+    char version[STRING_SIZE];
+
+    char commit[STRING_SIZE];
+    char zip_url[STRING_SIZE];
+    size_t zip_size;
+    char zip_sha256[SHA256_HEX_SIZE];
+
+    char cards_commit[STRING_SIZE];
+    char cards_pak_url[STRING_SIZE];
+    size_t cards_pak_size;
+    char cards_pak_sha256[SHA256_HEX_SIZE];
+    char cards_index_url[STRING_SIZE];
+
+    // a delta from the installed release to this one, if the release publishes it
+    char delta_from_commit[STRING_SIZE];
+    char delta_url[STRING_SIZE];
+    size_t delta_size;
+    char delta_sha256[SHA256_HEX_SIZE];
+
+} release_information;
+
+typedef struct {
+    char client_commit[STRING_SIZE];
+    char cards_commit[STRING_SIZE];
+    char cards_sha256[SHA256_HEX_SIZE];
+} installed_version;
+
+extern release_information bang_zip_information;
+
+extern const char *bang_base_dir;
+
+// if non zero, a cached release younger than this many seconds is used without contacting github
+extern int release_check_ttl;
+
+// bandwidth of stage_latest_version in bytes per second, 0 for no limit
+extern double stage_rate_limit;
+
+// root of the github api, it can be pointed to a mirror or to a local server
+extern char api_base_url[STRING_SIZE];
+
+#define PROGRESS_CLIENT 0
+#define PROGRESS_CARDS  1
+#define NUM_PROGRESS_CHANNELS 2
+
+// the frontend is notified of status changes through these callbacks, they can be called from any of the worker threads
+typedef struct {
+    void (*status)(const char *message);
+} updater_callbacks;
+
+extern updater_callbacks updater_ui;
+
+// workers publish their progress with atomic operations and never wait for the frontend,
+// which samples the counters at its own pace. phase is incremented every time the counters start over
+typedef struct {
+    atomic_ullong bytes_done;
+    atomic_ullong bytes_total;
+    atomic_uint phase;
+} progress_counter;
+
+extern progress_counter updater_progress[NUM_PROGRESS_CHANNELS];
+
+// measured during the last install, so that frontends can report where the time went
+typedef struct {
+    double zip_download_time;
+    size_t zip_download_bytes;
+    double cards_download_time;
+    size_t cards_download_bytes;
+    double unzip_time;
+    size_t unzip_bytes;
+    size_t unzip_skipped_bytes;
+    size_t write_bytes;
+    BOOL from_delta;
+} install_stats;
+
+extern install_stats last_install_stats;
+
+// measured during the last verification
+typedef struct {
+    double time;
+    long num_files;
+    long hashed_files;
+    size_t hashed_bytes;
+    long damaged_files;
+    long repaired_files;
+} verify_stats;
+
+extern verify_stats last_verify_stats;
+
+// reads the BANG_* environment variables and opens the shared http session
+int updater_init();
+void updater_cleanup();
+
+BOOL get_installed_version(installed_version *version);
+
+int get_bang_latest_version();
+
+// read the github responses of the release check, parse_bang_release fills bang_zip_information
+int parse_bang_release(const char *data, size_t size, const char *installed_commit);
+BOOL find_tree_field(const char *data, size_t size, const char *path, const char *field, char *dest);
+int must_download_latest_version(int *result);
+
+// downloads and installs the release in bang_zip_information, returns error_ok on success
+int install_latest_version();
+
+// downloads the latest release into the staging directory while the installed client is running, at stage_rate_limit,
+// and extracts the files that changed next to it. the marker file is written last, so a staged update is only applied
+// once it is complete. a release that is already staged is not downloaded again
+int stage_latest_version();
+
+// stops stage_latest_version at its next download chunk or extracted file, nothing is left marked as staged
+void cancel_staging();
+
+// installs an update staged during a previous session, before the client is loaded. the staged files are renamed
+// over the installed ones, a swap that is interrupted is finished at the next start
+int apply_staged_update();
+
+// checks the installed files against the file index: the files that kept their size and modification time are trusted,
+// the others are hashed on all cores. returns error_checksum_mismatch if files are missing or damaged.
+// with repair, only those are downloaded again, or the latest release is installed if it is not the installed one,
+// so bang_zip_information must have been filled by must_download_latest_version
+int verify_installation(BOOL repair);
+
+#endif